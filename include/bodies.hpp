@@ -0,0 +1,74 @@
+#pragma once
+
+#include "world.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace obf {
+
+struct Entity;
+
+// per-body physics state, kept in contiguous arrays so the integrator and gravity can walk it directly
+// entities only hold their slot, which moves when another body is removed
+struct Bodies {
+	uint32_t add(Entity* e);
+	// swap-removes, the last body takes over this slot
+	void remove(uint32_t slot);
+
+	inline size_t size() const {
+		return entity.size();
+	}
+
+	// the arrays as a WorldState, valid until a body is added or removed
+	WorldState view();
+
+	// remember positions before a fixed step so drawing can happen in between steps
+	void saveLast();
+	// moves bodies alpha of the way from their last position to the current one, until endInterpolation()
+	void beginInterpolation(double alpha);
+	void endInterpolation();
+
+	std::vector<double> x, y, velX, velY, mass, radius,
+	syncX, syncY, syncVelX, syncVelY,
+	lastX, lastY, heldX, heldY;
+	std::vector<Entity*> entity;
+	// inactive bodies neither attract nor get attracted, e.g. ones hit this tick
+	// hasLast is 0 for bodies added since the last saveLast(), they aren't interpolated
+	// rails bodies are placed on their orbit by followRails() instead of being pulled
+	// synced is 1 on clients when a state for the body came in since the last time one was applied
+	std::vector<uint8_t> attractor, active, hasLast, rails, synced;
+};
+
+inline Bodies bodies;
+
+// move every body by its velocity
+void integrate();
+// the same for any world, threaded uses the job system and is only allowed on the main thread
+void integrate(WorldState& world, double dt, bool threaded);
+// exact gravity: attractors pull everything, other bodies pull attractors back, bodies on rails aren't pulled
+// uses the widest kernel allowed by gravityKernel that the CPU supports, all kernels give bitwise identical results
+void applyGravity();
+void applyGravity(WorldState& world, double dt, bool threaded);
+// runs every kernel the CPU supports on the same random bodies and checks they agree with the scalar one bit for bit, prints a summary into report
+bool testGravityKernels(std::string& report);
+
+// drift and kick fractions of a step, drifts and kicks alternate starting with a drift, zero drifts are skipped
+struct Scheme {
+	const char* name;
+	int kicks;
+	double drift[4], kick[3];
+};
+// the scheme an integrator setting names, euler if it's unknown
+const Scheme& selectScheme(const std::string& name);
+// one step of delta ticks: integrate() and gravity interleaved the way the integrator setting says
+// euler drifts then kicks, leapfrog drifts half a step around its kick, yoshida is 4th order with three kicks a step
+// rails bodies are put where their orbit is after every drift and railTime moves on by delta
+void advance();
+// runs every integrator for steps steps of stepDelta ticks on forks of the current state without collisions
+// prints relative energy drift and time per step into report
+void testIntegrators(std::string& report, int steps, double stepDelta);
+
+}
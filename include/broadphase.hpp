@@ -0,0 +1,10 @@
+#pragma once
+
+namespace obf {
+
+// rebuilds near lists from a uniform spatial hash of every entity's scan reach
+// every collideScanSpacing all entities are rescanned together, in between only new ones are
+// only finds candidates, Entity::update2 still decides what actually collides
+void scanCollisions();
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace obf {
+
+// fixed point units used on the wire
+// positions in 1/16 units, velocities in 1/1024 units per tick, time in 1/1024 ticks
+constexpr double syncPosScale = 16.0, syncVelScale = 1024.0, syncTimeScale = 60.0 * 1024.0;
+// predicted displacement in position units is velocity * time >> syncMoveShift
+constexpr int syncMoveShift = 16;
+// how many sent snapshots a server remembers per player and a client remembers, must match
+constexpr size_t syncHistory = 32;
+constexpr int maxCoarseness = 14;
+
+struct SyncState {
+	uint32_t id;
+	int64_t x, y, velX, velY;
+	uint16_t rotation;
+	// position bits the encoder may drop, only used when encoding
+	uint8_t coarseness = 0;
+};
+
+// a snapshot in fixed point as both ends see it once it's been through the codec
+struct SyncFrame {
+	uint32_t tick = 0;
+	int64_t time = 0;
+	// sorted by id
+	std::vector<SyncState> states;
+};
+
+// what a server remembers of the snapshots it sent one client, the last one the client acked is the base for the next
+struct SnapshotSender {
+	SyncFrame frames[syncHistory];
+	size_t sent = 0;
+	uint32_t ackedTick = 0;
+	bool acked = false;
+};
+
+// what a client remembers of the snapshots it decoded, any of them may be the base of the next
+struct SnapshotReceiver {
+	SyncFrame frames[syncHistory];
+	size_t received = 0;
+	// the newest tick taken, older snapshots are dropped
+	uint32_t lastTick = 0;
+};
+
+SyncState quantizeState(uint32_t id, double x, double y, double velX, double velY, double rotation);
+void dequantizeState(const SyncState& s, double& x, double& y, double& velX, double& velY, double& rotation);
+
+// writes frame as changes from base, or whole if base is null
+// positions in frame are rounded to what the decoder will get so frame can serve as the next base
+void encodeFrame(std::string& out, const SyncFrame* base, SyncFrame& frame);
+// false if data is malformed, base has to be the same frame the encoder used
+bool decodeFrame(const std::string& data, const SyncFrame* base, SyncFrame& frame);
+
+// round trips random frames through the codec and checks the error bounds, prints a summary into report
+bool testCodec(std::string& report);
+
+}
@@ -1,9 +1,18 @@
 #pragma once
 
+#include "bodies.hpp"
+#include "codec.hpp"
+#include "interest.hpp"
+#include "kepler.hpp"
+#include "pool.hpp"
+#include "registry.hpp"
+#include "render.hpp"
+
+#include <atomic>
 #include <memory>
 #include <vector>
 
-#include <SFML/Graphics/CircleShape.hpp>
+#include <SFML/Graphics/Color.hpp>
 #include <SFML/Graphics/Text.hpp>
 #include <SFML/Network.hpp>
 
@@ -17,6 +26,19 @@ struct Entity;
 void setupShip(Entity* ship);
 
 void generateSystem();
+// Barnes-Hut alternative to applyGravity(): rebuilds the quadtree from attractors and applies their gravity to every body through it
+// small bodies pulling attractors back is negligible and skipped
+void applyTreeGravity();
+
+struct Attractor;
+
+// puts e on a Kepler orbit around parent, or around the system's center if parent is null, through its current state
+void putOnRails(Attractor* e, Attractor* parent, double parentMass);
+// moves every body on rails to where its orbit has it at time
+// as a server, ones that something else has moved since get derailed
+void followRails(double time);
+// takes e off rails for good and tells clients where it is
+void derail(Attractor* e);
 
 struct movement {
 	int forward: 1 = 0;
@@ -32,6 +54,8 @@ struct movement {
 struct Point {
 	double x;
 	double y;
+	// globalTime the body is predicted to be here at, spacing varies with adaptive prediction
+	double time;
 };
 
 bool operator ==(movement& mov1, movement& mov2);
@@ -47,30 +71,59 @@ struct Entity {
 
 	virtual void collide(Entity* with, bool collideOther);
 
-	std::vector<Entity*> near;
-	std::vector<Entity*> resNear;
+	std::vector<Handle> near;
 
 	void syncCreation();
+	// changes the ID, keeping entityMap in sync
+	void setID(uint32_t id);
 
 	virtual void loadCreatePacket(sf::Packet& packet) = 0;
 	virtual void unloadCreatePacket(sf::Packet& packet) = 0;
 	virtual void loadSyncPacket(sf::Packet& packet) = 0;
 	virtual void unloadSyncPacket(sf::Packet& packet) = 0;
 
-	virtual void simSetup();
-	virtual void simReset();
+	inline double& x() {
+		return bodies.x[body];
+	}
+	inline double& y() {
+		return bodies.y[body];
+	}
+	inline double& velX() {
+		return bodies.velX[body];
+	}
+	inline double& velY() {
+		return bodies.velY[body];
+	}
+	inline double& mass() {
+		return bodies.mass[body];
+	}
+	inline double& radius() {
+		return bodies.radius[body];
+	}
+	inline double& syncX() {
+		return bodies.syncX[body];
+	}
+	inline double& syncY() {
+		return bodies.syncY[body];
+	}
+	inline double& syncVelX() {
+		return bodies.syncVelX[body];
+	}
+	inline double& syncVelY() {
+		return bodies.syncVelY[body];
+	}
 
 	inline void setPosition(double x, double y) {
-		this->x = x;
-		this->y = y;
+		this->x() = x;
+		this->y() = y;
 	}
 	inline void setVelocity(double x, double y) {
-		velX = x;
-		velY = y;
+		velX() = x;
+		velY() = y;
 	}
 	inline void addVelocity(double dx, double dy) {
-		velX += dx;
-		velY -= dy;
+		velX() += dx;
+		velY() -= dy;
 	}
 
 	inline void setColor(uint8_t r, uint8_t g, uint8_t b) {
@@ -79,37 +132,57 @@ struct Entity {
 		color[2] = b;
 	}
 
-	std::unique_ptr<sf::CircleShape> icon;
 
 	std::vector<Point> trajectory;
+	// the line in trajectoryLines drawing it, noLine if it has none
+	size_t trajectoryLine = noLine;
 
 	virtual uint8_t type() = 0;
 	Player* player = nullptr;
-	double x = 0.0, y = 0.0, velX = 0.0, velY = 0.0, rotation = 0.0, rotateVel = 0.0,
-	radius = 0.0,
-	mass = 0.0,
-	lastCollideCheck = 0.0, lastCollideScan = 0.0,
-	resX = 0.0, resY = 0.0, resVelX = 0.0, resVelY = 0.0, resRotation = 0.0, resRotateVel = 0.0, resMass = 0.0, resRadius = 0.0, resCollideScan = 0.0,
-	syncX = 0.0, syncY = 0.0, syncVelX = 0.0, syncVelY = 0.0;
-	bool ghost = false, ai = false;
-	Entity* simRelBody = nullptr;
+	double rotation = 0.0, rotateVel = 0.0,
+	lastCollideCheck = 0.0, lastCollideScan = 0.0;
+	// slot in bodies, holds position, velocity, mass and radius
+	uint32_t body;
+	Handle handle;
+	// position in updateGroup, noGroup if not in it
+	size_t groupIndex = noGroup;
+	bool ai = false;
+	Handle simRelBody;
 	unsigned char color[3]{255, 255, 255};
 	uint32_t id;
 };
 
+constexpr uint32_t noBody = UINT32_MAX, noRailParent = UINT32_MAX;
+
 struct Quad {
-	void put(Entity* e);
+	void put(uint32_t b);
 	Quad& getChild(uint8_t at);
+	// Barnes-Hut walk, nodes that look smaller than barnesHutTheta from body b act as a single body
+	void pull(uint32_t b);
 
-	uint16_t children[4] = {0, 0, 0, 0};
-	Entity* entity = nullptr;
-	double size, x, y, mass = 0.0;
+	uint32_t children[4] = {0, 0, 0, 0};
+	// body slot of a leaf, noBody for inner nodes
+	uint32_t body = noBody;
+	double size, x, y, mass = 0.0, comX = 0.0, comY = 0.0;
 	bool used = false;
 };
 
+// what a ship's controls change, plain data so it can be steered away from its Triangle
+struct ShipState {
+	double velX, velY, rotation, rotateVel, lastBoosted, lastShot, hyperboostCharge;
+	bool burning, fired = false;
+};
+
 struct Triangle: public Entity {
 	Triangle();
 
+	// what the engine looks like after steering, in the order of its colors
+	enum class Exhaust : uint8_t {
+		None, Forward, Backward, Boost, Hyperboost, Charging, Afterburn
+	};
+	// applies cont to s for dt ticks at time now, fired gets set if a shot should go out
+	static Exhaust steer(ShipState& s, movement& cont, double dt, double now);
+
 	void control(movement& cont) override;
 	void draw() override;
 
@@ -118,19 +191,19 @@ struct Triangle: public Entity {
 	void loadSyncPacket(sf::Packet& packet) override;
 	void unloadSyncPacket(sf::Packet& packet) override;
 
-	void simSetup() override;
-	void simReset() override;
-
 	uint8_t type() override;
-	double accel = 0.015, rotateSlowSpeedMult = 2.0 / 3.0, rotateSpeed = 3.0 / 60.0, boostCooldown = 12.0, boostStrength = 1.5, reload = 8.0, shootPower = 4.0, hyperboostStrength = 0.12, hyperboostTime = 20.0 * 60.0, hyperboostRotateSpeed = rotateSpeed * 0.02, afterburnStrength = 0.3, minAfterburn = hyperboostTime + 8.0 * 60.0,
-	lastBoosted = -boostCooldown, lastShot = -reload, hyperboostCharge = 0.0,
-	resLastBoosted = 0.0, resLastShot = 0.0, resHyperboostCharge = 0.0;
+	static constexpr double accel = 0.015, rotateSlowSpeedMult = 2.0 / 3.0, rotateSpeed = 3.0 / 60.0, boostCooldown = 12.0, boostStrength = 1.5, reload = 8.0, shootPower = 4.0, hyperboostStrength = 0.12, hyperboostTime = 20.0 * 60.0, hyperboostRotateSpeed = rotateSpeed * 0.02, afterburnStrength = 0.3, minAfterburn = hyperboostTime + 8.0 * 60.0;
+	double lastBoosted = -boostCooldown, lastShot = -reload, hyperboostCharge = 0.0;
 	int kills = 0;
 
-	bool burning = false, resBurning;
+	bool burning = false;
 	std::string name = "";
+	// name as it's drawn, laid out again only when it changes
+	TextLayout nameLayout;
 
-	std::unique_ptr<sf::CircleShape> shape, forwards;
+	// the engine marker's look after the last steer
+	sf::Color forwardsColor = sf::Color::White;
+	float forwardsRotation = 0.f;
 };
 
 struct Attractor: public Entity {
@@ -138,7 +211,6 @@ struct Attractor: public Entity {
 	Attractor(double radius, double mass);
 	Attractor(bool ghost);
 
-	void update2() override;
 	void draw() override;
 
 	void loadCreatePacket(sf::Packet& packet) override;
@@ -150,11 +222,20 @@ struct Attractor: public Entity {
 
 	bool star = false, blackhole = false;
 
-	std::unique_ptr<sf::CircleShape> shape, warning;
+	// with bodies.rails set, where this orbits relative to entity railParent, noRailParent for the system's center
+	Orbit orbit;
+	uint32_t railParent = noRailParent, railPass = 0;
+	// the velocity followRails() last gave it
+	double railVelX = 0.0, railVelY = 0.0;
 };
 
 struct Projectile: public Entity {
 	Projectile();
+	~Projectile() noexcept;
+
+	// projectiles come and go with every shot, they live in projectilePool instead of on the heap
+	static void* operator new(size_t size);
+	static void operator delete(void* p);
 
 	void draw() override;
 
@@ -167,20 +248,46 @@ struct Projectile: public Entity {
 
 	uint8_t type() override;
 
-	Triangle* owner = nullptr;
-
-	std::unique_ptr<sf::CircleShape> shape;
+	// the Triangle that fired this
+	Handle owner;
 };
 
+inline Pool projectilePool(sizeof(Projectile), 256);
+
 struct Player {
 	~Player();
 
 	std::string name();
 
+	// hands a packet to the network thread, false once the player is disconnected
+	bool send(sf::Packet& packet);
+	// asks the network thread to hang up, the player gets deleted once it has
+	void close();
+
+	// network thread only, buffer is false if there's no room and flush is false if the socket broke
+	bool buffer(const sf::Packet& packet);
+	bool flush();
+
 	Entity* entity = nullptr;
 
 	sf::TcpSocket tcpSocket;
-	std::vector<sf::Packet> tcpQueue;
+	// network thread only, ring buffer of packets waiting to be sent, framed like sf::TcpSocket does it
+	std::vector<char> outbound;
+	size_t outStart = 0, outSize = 0;
+	bool hungUp = false;
+	// bytes handed to the network thread that haven't gone out yet
+	std::atomic<size_t> queued = 0;
+	bool disconnected = false;
+	std::vector<sf::Packet> tcpQueue, udpQueue;
+	// snapshots go over udp once the client has said hello with this token from udpAddress:udpPort
+	sf::IpAddress udpAddress;
+	uint32_t udpToken = 0, udpSequence = 0;
+	unsigned short udpPort = 0;
+	// snapshots sent with deltaSync
+	SnapshotSender snapshots;
+	// with interestSync, what's in its area of interest sorted by id, and how many bytes a state has been taking up lately
+	std::vector<Interest> known;
+	double stateCost = 44.0;
 	std::string username = "", ip = "";
 	double lastAck = 0.0, lastPingSent = 0.0, lastSynced = 0.0, lastFullsynced = 0.0, ping = 0.0,
 	viewW = 500.0, viewH = 500.0;
@@ -14,24 +14,24 @@ namespace obf {
 
 inline sf::TcpSocket* serverSocket = nullptr;
 inline sf::TcpListener* connectListener = nullptr;
+inline sf::UdpSocket* udpSocket = nullptr;
 inline sf::RenderWindow* window = nullptr;
 inline obf::Entity* ownEntity = nullptr;
-inline sf::Text* posInfo = nullptr;
-inline sf::Text* chat = nullptr;
 inline sf::Font* font = nullptr;
 inline obf::Player* sparePlayer = new obf::Player;
 inline std::vector<Entity*> updateGroup;
 inline std::vector<Player*> playerGroup;
 inline std::vector<Entity*> entityDeleteBuffer;
-inline std::vector<Entity*> simCleanupBuffer;
 inline std::vector<Attractor*> planets;
 inline std::vector<std::vector<Point>> ghostTrajectories;
 inline std::vector<sf::Color> ghostTrajectoryColors;
 inline sf::Vector2i mousePos;
-inline sf::Clock deltaClock, globalClock;
+inline sf::Clock deltaClock, globalClock, tickClock;
 inline std::future<void> inputReader;
 inline std::string serverAddress = "", name = "",
-inputBuffer = "";
+inputBuffer = "",
+gravityKernel = "auto",
+integrator = "euler";
 inline sf::String chatBuffer = "";
 inline unsigned short port = 7817;
 inline movement lastControls, controls;
@@ -47,21 +47,29 @@ inline double delta = 1.0 / 60.0,
 	gen_baseDensity = 8.0e9, gen_moonFactor = gen_maxPlanetRadius * 0.24, gen_minMoonDistance = 2.0, gen_maxMoonDistance = 9.0,
 	gen_minMoonRadius = 120.0, gen_maxMoonRadiusFrac = 1.0 / 6.0,
 	syncCullThreshold = 0.6, syncCullOffset = 100000.0, sweepThreshold = 4e6 * 4e6,
-	predictSpacing = 0.2, predictDelta = 6.0,
-	extraQuadAllocation = 1.2, quadtreeShrinkThreshold = 0.4,
+	syncPrecision = 4096.0, udpLoss = 0.0, syncBandwidth = 64.0 * 1024.0,
+	predictSpacing = 0.2, predictDelta = 6.0, predictTolerance = 50.0, predictAccuracy = 0.01, predictMinDelta = 0.25, predictMaxDelta = 60.0,
+	extraQuadAllocation = 1.2, quadtreeShrinkThreshold = 0.4, minQuadSize = 1.0e-3,
+	barnesHutTheta = 0.5,
+	lodIconRadius = 0.5,
 	autorestartSpacing = 30.0 * 60.0 + 1, autorestartNotifSpacing = 5.0 * 60.0,
 	G = 6.67e-11,
 	targetFramerate = 90.0,
-	lastPing = 0.0, lastPredict = 0.0, lastSweep = 0.0, lastAutorestartNotif = -autorestartNotifSpacing, lastAutorestart = 0.0,
+	tickRate = 60.0, stepAccumulator = 0.0,
+	lastPing = 0.0, lastUdpHello = 0.0, lastPredict = 0.0, lastPredictRequest = 0.0, lastSweep = 0.0, lastFullScan = 0.0, lastAutorestartNotif = -autorestartNotifSpacing, lastAutorestart = 0.0,
 	lastShowFramerate = 0.0,
-	predictingFor = 0.0,
+	// seconds spent working each tick over the last second, not counting the sleep
+	tickTime = 0.0, tickJitter = 0.0, worstTick = 0.0,
+	measureWork = 0.0, measureWork2 = 0.0, measureWorstTick = 0.0,
 	drawShiftX = 0.0, drawShiftY = 0.0,
 	ownX = 0.0, ownY = 0.0;
 inline const int displayMessageCount = 7, storedMessageCount = 40;
 inline int messageLimit = 50,
 usernameLimit = 24,
 textCharacterSize = 18,
-nextID = 0,
+threads = 0,
+sendBufferSize = 4 << 20,
+maxSubsteps = 8,
 predictSteps = (int)(30.0 / predictDelta * 60.0),
 gen_baseMinPlanets = 5,
 gen_baseMaxPlanets = 10,
@@ -69,12 +77,28 @@ messageCursorPos = storedMessageCount - displayMessageCount,
 quadsConstructed = 60,
 quadsAllocated = (int)(quadsConstructed * extraQuadAllocation);
 inline long long measureFrames = 0, framerate = 0;
-inline size_t trajectoryOffset = 0;
+// clients number their own entities from localIDStart up so they never clash with IDs from the server
+inline const uint32_t localIDStart = 1u << 31;
+inline uint32_t nextID = 0;
+// server ticks since startup, snapshots are stamped with it
+inline uint32_t tickCount = 0;
+// as a client, the token the server gave us for udp and the sequence number of the last datagram from it
+inline uint32_t udpToken = 0, udpSequence = 0;
+// udpSequence is only the newest datagram's once one came in
+inline bool udpConfirmed = false, udpSequenced = false;
+// ticks simulated since startup, orbits on rails are evaluated at it
+inline double railTime = 0.0;
 inline bool headless = false, autoConnect = false, debug = false, autorestart = false,
 inputWaiting = false, chatting = false, lockControls = false,
 enableControlLock = false,
-simulating = false,
-autorestartRegenned = true, fullclearing = false;
+barnesHut = false,
+fixedStep = true,
+onRails = false,
+predictMassless = false, predictAdaptive = false,
+batchSync = true, deltaSync = true, udpSync = true, interestSync = true, threadedNet = true,
+autorestartRegenned = true, fullclearing = false,
+// set when the world was just cleared or regenerated, the next stepWorld() skips its steps instead of catching up
+skipStep = false;
 
 inline obf::Quad* quadtree = (Quad*)malloc((size_t)(sizeof(Quad) * quadsAllocated));
 
@@ -93,6 +117,13 @@ inline std::map<std::string, Var> vars {
 	{"predictDelta", {Double, &predictDelta}},
 	{"predictSpacing", {Double, &predictSpacing}},
 	{"predictSteps", {Int, &predictSteps}},
+	{"predictTolerance", {Double, &predictTolerance}},
+	{"predictMassless", {Bool, &predictMassless}},
+	{"lodIconRadius", {Double, &lodIconRadius}},
+	{"predictAdaptive", {Bool, &predictAdaptive}},
+	{"predictAccuracy", {Double, &predictAccuracy}},
+	{"predictMinDelta", {Double, &predictMinDelta}},
+	{"predictMaxDelta", {Double, &predictMaxDelta}},
 
 	{"autoConnect", {Bool, &autoConnect}},
 	{"DEBUG", {Bool, &debug}},
@@ -103,15 +134,33 @@ inline std::map<std::string, Var> vars {
 	{"autorestartSpacing", {Double, &autorestartSpacing}},
 
 	{"maxAckTime", {Double, &maxAckTime}},
+	{"sendBufferSize", {Int, &sendBufferSize}},
 	{"syncSpacing", {Double, &syncSpacing}},
 	{"fullSyncSpacing", {Double, &fullsyncSpacing}},
+	{"batchSync", {Bool, &batchSync}},
+	{"deltaSync", {Bool, &deltaSync}},
+	{"syncPrecision", {Double, &syncPrecision}},
+	{"udpSync", {Bool, &udpSync}},
+	{"udpLoss", {Double, &udpLoss}},
+	{"threadedNet", {Bool, &threadedNet}},
+	{"interestSync", {Bool, &interestSync}},
+	{"syncBandwidth", {Double, &syncBandwidth}},
 	{"targetFramerate", {Double, &targetFramerate}},
+	{"fixedStep", {Bool, &fixedStep}},
+	{"tickRate", {Double, &tickRate}},
+	{"maxSubsteps", {Int, &maxSubsteps}},
 
 	{"sweepThreshold", {Double, &sweepThreshold}},
 
 	{"friction", {Double, &friction}},
 	{"collideRestitution", {Double, &collideRestitution}},
 	{"gravityStrength", {Double, &G}},
+	{"barnesHut", {Bool, &barnesHut}},
+	{"onRails", {Bool, &onRails}},
+	{"barnesHutTheta", {Double, &barnesHutTheta}},
+	{"gravityKernel", {String, &gravityKernel}},
+	{"integrator", {String, &integrator}},
+	{"threads", {Int, &threads}},
 
 	{"gen_baseDensity", {Double, &gen_baseDensity}},
 	{"gen_baseMinPlanets", {Int, &gen_baseMinPlanets}},
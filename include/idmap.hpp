@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace obf {
+
+struct Entity;
+
+// entity ID -> entity, open addressing with linear probing
+// kept up to date by Entity's constructor, destructor and setID
+struct EntityMap {
+	Entity* get(uint32_t id) const;
+	void put(uint32_t id, Entity* e);
+	// only removes the entry if it still points at e, a newer entity may have taken the ID
+	void remove(uint32_t id, Entity* e);
+
+	inline size_t size() const {
+		return count;
+	}
+
+private:
+	struct Slot {
+		uint32_t id;
+		Entity* entity = nullptr;
+	};
+
+	size_t find(uint32_t id) const;
+	void grow();
+
+	std::vector<Slot> slots;
+	size_t count = 0;
+};
+
+inline EntityMap entityMap;
+
+}
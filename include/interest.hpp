@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace obf {
+
+struct Entity;
+struct Player;
+
+// an entity a player is getting states of
+struct Interest {
+	uint32_t id;
+	// grows every sync the entity is left out by how much its stale state matters, reset when it's sent
+	float priority;
+};
+
+// grids every synced entity by position so each player only looks at the cells around it, call once per sync before selectInterest()
+// cells fit the biggest area of interest of players
+void indexInterest(const std::vector<Player*>& players);
+// what player gets a state of this sync: whatever just came near, its own ship, then the rest by priority until syncBandwidth runs out
+// leaving gets the ones that went out of its area since the last call, safe to call for different players at once
+void selectInterest(Player* player, std::vector<Entity*>& visible, std::vector<Entity*>& leaving);
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace obf {
+
+// thread pool, each worker has its own job deque and steals from the others when it runs dry
+// threads is the total count including the calling thread, 0 picks the hardware thread count
+void startJobs(int threads);
+void stopJobs();
+
+// runs fn(from, to) over chunks of [0, n) no smaller than grain, the calling thread helps out
+// returns once every chunk is done, only call this from the main thread
+void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+namespace obf {
+
+// a closed elliptic two-body orbit, positions and velocities relative to what it orbits
+// units are the simulation's: time in ticks, velocities per tick, mu is G times the masses involved
+struct Orbit {
+	double mu = 0.0, a = 0.0, e = 0.0,
+	// direction of periapsis in radians
+	periapsis = 0.0,
+	// mean anomaly at epoch, in radians
+	meanAnomaly = 0.0, epoch = 0.0;
+	// -1 for clockwise orbits, 1 otherwise
+	double turn = 1.0;
+};
+
+// fits the orbit passing through the relative state at time, false if it isn't a closed ellipse
+bool fitOrbit(Orbit& orbit, double x, double y, double velX, double velY, double mu, double time);
+// where the orbit puts the body at time, solved in closed form so error doesn't build up over steps
+void orbitState(const Orbit& orbit, double time, double& x, double& y, double& velX, double& velY);
+
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace obf {
+
+// as a server, connects that many fake clients to itself over loopback that flood it with tcp controls and udp acks
+// measures ticks for seconds with threadedNet on and then off, prints both like ticktime and disconnects them
+void startLoadTest(int clients, double seconds);
+// moves a running load test along, call once per server tick
+void updateLoadTest();
+
+}
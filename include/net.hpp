@@ -7,5 +7,23 @@ namespace obf {
     void clientParsePacket(sf::Packet&);
     void serverParsePacket(sf::Packet&, Player*);
 
+    // one Packets::Snapshot carrying the states of every entity in the list
+    void loadSnapshot(sf::Packet&, const std::vector<Entity*>&);
+    // last full precision states of entities that left a player's interest, sent reliably so the client can carry on from them
+    void loadSleep(sf::Packet&, const std::vector<Entity*>&);
+    // same as loadSnapshot but quantized and delta encoded against the last snapshot the player acked
+    void loadDeltaSnapshot(sf::Packet&, Player*, std::vector<Entity*>&);
+    // forget received snapshots, for when connecting to a server
+    void resetSync();
+
+    // snapshots go over udp so a lost one doesn't hold up the rest, everything else stays on tcp
+    uint32_t newUdpToken();
+    void sendUdp(Player*, sf::Packet&);
+    void clientReceiveUdp();
+    void serverParseDatagram(sf::Packet&, const sf::IpAddress&, unsigned short);
+    // sends delta snapshots and their acks both ways over loopback udp with udpLoss (or 0.2), reordering and duplicates
+    // checks every one the client takes decodes, matches what was sent and is newer than the last, prints a summary into report
+    bool testUdpSync(std::string&);
+
     void relayMessage(std::string&);
 }
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+
+#include <SFML/Network.hpp>
+
+namespace obf {
+
+struct Player;
+
+// one thread pushes, one other thread pops, neither ever waits for the other
+// nodes the consumer is done with go back to the producer, so once it has grown to its busiest it stops allocating
+template <typename T>
+struct SpscQueue {
+	SpscQueue() {
+		first = spent = tail = new Node;
+		head.store(first, std::memory_order_relaxed);
+	}
+	~SpscQueue() {
+		while (first) {
+			Node* next = first->next.load(std::memory_order_relaxed);
+			delete first;
+			first = next;
+		}
+	}
+
+	// producer only
+	void push(T&& value) {
+		Node* node = take();
+		node->value = std::move(value);
+		node->next.store(nullptr, std::memory_order_relaxed);
+		tail->next.store(node, std::memory_order_release);
+		tail = node;
+	}
+	// consumer only, false if there was nothing
+	bool pop(T& out) {
+		Node* current = head.load(std::memory_order_relaxed);
+		Node* next = current->next.load(std::memory_order_acquire);
+		if (!next) {
+			return false;
+		}
+		out = std::move(next->value);
+		// after this the producer may reuse current
+		head.store(next, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Node {
+		T value;
+		std::atomic<Node*> next = nullptr;
+	};
+
+	// producer only, a node the consumer has moved past or a new one if it hasn't moved past any
+	Node* take() {
+		if (first == spent) {
+			spent = head.load(std::memory_order_acquire);
+			if (first == spent) {
+				return new Node;
+			}
+		}
+		Node* node = first;
+		first = first->next.load(std::memory_order_relaxed);
+		return node;
+	}
+
+	// the list runs first -> ... -> head -> ... -> tail
+	// nodes before spent are the producer's to reuse, head is the consumer's spent node, tail is the newest
+	std::atomic<Node*> head;
+	Node* first;
+	Node* spent;
+	Node* tail;
+};
+
+// network thread -> simulation
+struct NetEvent {
+	NetEvent() = default;
+	NetEvent(uint8_t type, Player* player, const char* reason = "") : type((Type)type), player(player), reason(reason) {}
+
+	enum Type : uint8_t {
+		Connected, // player was accepted, the simulation owns it from here
+		Received, // a tcp packet from player
+		Datagram, // a udp packet from address:port
+		Disconnected, // player's socket is gone, reason says why
+		Closed // the network thread is done with player after a Close, it can be deleted
+	} type = Received;
+	Player* player = nullptr;
+	sf::Packet packet;
+	sf::IpAddress address;
+	unsigned short port = 0;
+	const char* reason = "";
+};
+
+// simulation -> network thread
+struct NetCommand {
+	NetCommand() = default;
+	NetCommand(uint8_t type, Player* player) : type((Type)type), player(player) {}
+	NetCommand(uint8_t type, Player* player, const sf::Packet& packet) : type((Type)type), player(player), packet(packet) {}
+
+	enum Type : uint8_t {
+		Send, // queue packet on player's tcp socket
+		SendDatagram, // send packet to address:port over udp
+		Close // hang up on player and answer with Closed
+	} type = Send;
+	Player* player = nullptr;
+	sf::Packet packet;
+	sf::IpAddress address;
+	unsigned short port = 0;
+};
+
+inline SpscQueue<NetEvent> netEvents;
+inline SpscQueue<NetCommand> netCommands;
+
+// as a server, gives the listener, the udp socket and every player's socket a thread of their own
+// the simulation only talks to it through netEvents and netCommands after this
+void startNetThread();
+void stopNetThread();
+bool netThreadRunning();
+// with the network thread stopped, does one round of its work on the calling thread without waiting for anything to arrive
+void pollNetwork();
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace obf {
+
+// fixed size slots carved out of slabs, released slots go on a free list and are handed out again first
+// so a steady churn of objects doesn't touch the heap once there are enough slabs
+struct Pool {
+	Pool(size_t size, size_t perSlab);
+	Pool(const Pool&) = delete;
+	Pool& operator =(const Pool&) = delete;
+
+	void* acquire();
+	void release(void* slot);
+
+	// heap allocations made for slabs, slots in use and slots ever acquired
+	size_t slabs = 0, live = 0, acquired = 0;
+
+private:
+	size_t size, perSlab;
+	std::vector<std::unique_ptr<char[]>> storage;
+	// released slots hold the next free one
+	void* freeList = nullptr;
+};
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "bodies.hpp"
+#include "entities.hpp"
+#include "world.hpp"
+
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics/Color.hpp>
+
+namespace obf {
+
+// a copy of the world for prediction to step on its own thread, taken by snapshotPrediction()
+struct PredictJob {
+	// the fork lives in arena, trajectories are returned per id in world.ids
+	Arena arena;
+	WorldState world;
+	// the body trajectories are relative to, -1 for the center of the stars
+	int32_t ref = -1;
+	uint32_t refID = 0;
+	// own ship keeps steering with controls, a ghost of it that doesn't gets a trajectory too
+	int32_t ship = -1;
+	ShipState shipState;
+	movement controls;
+	unsigned char shipColor[3]{255, 255, 255};
+	// steps of step ticks until horizon ticks from time, adaptive ones are accuracy of the shortest free-fall time within minStep and maxStep
+	double time = 0.0, step = 1.0, horizon = 0.0, tolerance = 0.0, accuracy = 0.01, minStep = 1.0, maxStep = 1.0;
+	bool adaptive = false;
+	std::string integrator;
+};
+
+struct Prediction {
+	// trajectories[i] belongs to entity ids[i], points are relative to refID after every step and stamped with its time
+	std::vector<uint32_t> ids;
+	std::vector<std::vector<Point>> trajectories;
+	// the ghost of the own ship and projectiles it would fire
+	std::vector<std::vector<Point>> ghosts;
+	std::vector<sf::Color> ghostColors;
+	uint32_t refID = 0;
+	bool refCenter = false;
+	// globalTime the first point is one step after
+	double startTime = 0.0;
+	// points taken over from the last prediction instead of being simulated again, the most of any trajectory
+	int reused = 0;
+};
+
+// copies what prediction needs from the live world, call on the main thread
+void snapshotPrediction(PredictJob& job);
+// whether the prediction thread is still on the last request, snapshots taken meanwhile would be thrown away
+bool predictionBusy();
+// hands job to the prediction thread, starting it if needed, false if it's still busy with the last one
+// job gets swapped with an old one so its buffers can be reused
+bool requestPrediction(PredictJob& job);
+// gives entities the trajectories of the newest finished prediction if there's one that hasn't been applied yet
+// the prediction thread builds the next one in its own buffer meanwhile, false if there was nothing new
+bool applyPrediction();
+void stopPrediction();
+
+}
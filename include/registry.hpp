@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace obf {
+
+struct Entity;
+
+constexpr size_t noGroup = SIZE_MAX;
+
+// weak reference to an entity, goes stale instead of dangling once the entity is deleted
+struct Handle {
+	uint32_t index = UINT32_MAX, generation = 0;
+};
+
+// generational slots: deleting an entity bumps its slot's generation, invalidating every handle to it at once
+struct Registry {
+	Handle add(Entity* e);
+	void remove(Handle h);
+	// nullptr if the entity has been deleted
+	inline Entity* get(Handle h) const {
+		return h.index < entities.size() && generations[h.index] == h.generation ? entities[h.index] : nullptr;
+	}
+
+private:
+	std::vector<Entity*> entities;
+	std::vector<uint32_t> generations, freeSlots;
+};
+
+inline Registry registry;
+
+// O(1) updateGroup membership through Entity::groupIndex
+void addToGroup(Entity* e);
+void removeFromGroup(Entity* e);
+// fixes every groupIndex after updateGroup was replaced wholesale
+void reindexGroup();
+
+}
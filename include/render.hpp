@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/String.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+#include <SFML/Graphics/VertexBuffer.hpp>
+
+namespace obf {
+
+struct Point;
+
+// shapes of one layer collected over a frame and drawn with a single call
+struct Batch {
+	// a filled regular polygon with its points where sf::CircleShape puts them, rotated clockwise by rotation degrees
+	void circle(float x, float y, float radius, int points, sf::Color color, float rotation = 0.f);
+	// only the outline of one, thickness going outwards
+	void ring(float x, float y, float radius, int points, float thickness, sf::Color color);
+	void rect(float x, float y, float w, float h, sf::Color color);
+	// draws everything added since the last flush with the current view, keeping the memory for next frame
+	void flush();
+
+	sf::VertexArray vertices{sf::Triangles};
+};
+
+// bodies in world coordinates and icons in window coordinates, flushed once a frame after every entity is drawn
+inline Batch worldBatch, uiBatch;
+
+// whether anything within reach of x, y in draw shifted world coordinates can be in the window
+bool onScreen(double x, double y, double reach);
+// how many points a circle of radius needs at the current zoom to look round, between 4 and most
+// keeps the edges within about a third of a pixel of the circle, 0 if it's too small to draw instead of its icon
+int circlePoints(double radius, int most);
+
+// a string laid out from the font's glyphs, set() only lays it out again when the text or size changed
+struct TextLayout {
+	// true if it changed
+	inline bool set(const char* text, unsigned size) {
+		return setAnsi(text, size);
+	}
+	inline bool set(const std::string& text, unsigned size) {
+		return setAnsi(text, size);
+	}
+	bool set(const sf::String& text, unsigned size);
+
+	// white glyph quads with the top left of the first line at 0, 0
+	std::vector<sf::Vertex> vertices;
+	float width = 0.f;
+	unsigned size = 0;
+
+private:
+	bool setAnsi(std::string_view text, unsigned size);
+	void layout();
+
+	std::string ansi;
+	sf::String unicode;
+	std::vector<uint32_t> codepoints;
+};
+
+// glyph quads of one character size, drawn with that size's page of the font texture in one call
+struct TextBatch {
+	void add(const TextLayout& text, float x, float y, sf::Color color);
+	void flush();
+
+	sf::VertexArray vertices{sf::Triangles};
+	unsigned size = 0;
+};
+
+// ship names over the icons and the info and chat text, in window coordinates
+inline TextBatch labelBatch, hudBatch;
+// renders the printable ASCII glyphs of size into the font texture up front instead of as they first show up
+void prepareGlyphs(unsigned size);
+
+constexpr size_t noLine = SIZE_MAX;
+
+// predicted trajectories as line strips relative to their reference body, uploaded once per prediction
+// kept on the GPU when vertex buffers are available, buffers are reused by the next prediction
+struct TrajectoryLines {
+	// replaces line i with points, fading out towards the end
+	void upload(size_t i, const std::vector<Point>& points, sf::Color color);
+	// draws line i from point from on, with the reference body at x, y
+	void draw(size_t i, size_t from, float x, float y);
+
+private:
+	struct Line {
+		std::vector<sf::Vertex> vertices;
+		// bounds of every point, lines entirely off screen aren't drawn
+		float minX, minY, maxX, maxY;
+		std::unique_ptr<sf::VertexBuffer> buffer;
+		size_t capacity = 0;
+	};
+	std::vector<Line> lines;
+};
+
+// entity trajectories by their index in the prediction and ghost trajectories
+inline TrajectoryLines trajectoryLines, ghostLines;
+
+}
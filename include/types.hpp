@@ -16,7 +16,14 @@ constexpr uint16_t Ping = 0,
 	ResizeView = 10,
 	Name = 11,
 	PlanetCollision = 12,
-	SyncDone = 13;
+	SyncDone = 13,
+	Snapshot = 14,
+	DeltaSnapshot = 15,
+	SnapshotAck = 16,
+	UdpToken = 17,
+	UdpHello = 18,
+	Derail = 19,
+	Sleep = 20;
 }
 
 namespace obf::Entities {
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "kepler.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace obf {
+
+// bump allocator for forks of the world, everything in it is let go at once by reset()
+struct Arena {
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena& operator =(const Arena&) = delete;
+	Arena(Arena&&) = default;
+	Arena& operator =(Arena&&) = default;
+
+	void* allocate(size_t bytes, size_t align);
+	template <typename T>
+	T* make(size_t count) {
+		return (T*)allocate(count * sizeof(T), alignof(T));
+	}
+	// keeps the biggest block so the next fork of the same size doesn't allocate
+	void reset();
+
+private:
+	std::vector<std::unique_ptr<char[]>> blocks;
+	size_t blockSize = 0, used = 0;
+};
+
+struct Scheme;
+
+// plain data of everything physics needs, arrays by slot
+// it either views the live bodies or points into the Arena a fork was made in, copying it only copies the view
+struct WorldState {
+	size_t count = 0, capacity = 0;
+	double* x = nullptr, * y = nullptr, * velX = nullptr, * velY = nullptr, * mass = nullptr, * radius = nullptr;
+	uint8_t* attractor = nullptr, * active = nullptr, * rails = nullptr, * star = nullptr;
+	// null when viewing the live bodies, entities have those there
+	Orbit* orbits = nullptr;
+	// slot a rails body orbits, -1 for the system's center
+	int32_t* railParents = nullptr;
+	uint32_t* ids = nullptr;
+	// railTime of the world, the live one is in railTime
+	double railTime = 0.0;
+	// non-attractors are test particles: attractors pull them but they don't pull back
+	bool massless = false;
+
+	// adds an active body with everything else zeroed, moving the world to a bigger fork in arena if it's full
+	uint32_t add(Arena& arena);
+	inline size_t size() const {
+		return count;
+	}
+};
+
+// the live world's active bodies in updateGroup order, room for extra more bodies
+// without particles only attractors are taken
+WorldState captureWorld(Arena& arena, size_t extra, bool particles = true);
+// a copy of world that can be stepped without touching it
+WorldState fork(const WorldState& world, Arena& arena, size_t extra);
+// one step of dt ticks with scheme on a fork, on the calling thread, rails bodies follow their orbits
+void advance(WorldState& world, double dt, const Scheme& scheme);
+
+}
@@ -0,0 +1,233 @@
+#include "bodies.hpp"
+#include "entities.hpp"
+#include "globals.hpp"
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace obf {
+
+uint32_t Bodies::add(Entity* e) {
+	x.push_back(0.0);
+	y.push_back(0.0);
+	velX.push_back(0.0);
+	velY.push_back(0.0);
+	mass.push_back(0.0);
+	radius.push_back(0.0);
+	syncX.push_back(0.0);
+	syncY.push_back(0.0);
+	syncVelX.push_back(0.0);
+	syncVelY.push_back(0.0);
+	lastX.push_back(0.0);
+	lastY.push_back(0.0);
+	entity.push_back(e);
+	attractor.push_back(0);
+	active.push_back(1);
+	hasLast.push_back(0);
+	rails.push_back(0);
+	synced.push_back(0);
+	return entity.size() - 1;
+}
+
+void Bodies::remove(uint32_t slot) {
+	size_t last = entity.size() - 1;
+	if (slot != last) {
+		x[slot] = x[last];
+		y[slot] = y[last];
+		velX[slot] = velX[last];
+		velY[slot] = velY[last];
+		mass[slot] = mass[last];
+		radius[slot] = radius[last];
+		syncX[slot] = syncX[last];
+		syncY[slot] = syncY[last];
+		syncVelX[slot] = syncVelX[last];
+		syncVelY[slot] = syncVelY[last];
+		lastX[slot] = lastX[last];
+		lastY[slot] = lastY[last];
+		entity[slot] = entity[last];
+		attractor[slot] = attractor[last];
+		active[slot] = active[last];
+		hasLast[slot] = hasLast[last];
+		rails[slot] = rails[last];
+		synced[slot] = synced[last];
+		entity[slot]->body = slot;
+	}
+	x.pop_back();
+	y.pop_back();
+	velX.pop_back();
+	velY.pop_back();
+	mass.pop_back();
+	radius.pop_back();
+	syncX.pop_back();
+	syncY.pop_back();
+	syncVelX.pop_back();
+	syncVelY.pop_back();
+	lastX.pop_back();
+	lastY.pop_back();
+	entity.pop_back();
+	attractor.pop_back();
+	active.pop_back();
+	hasLast.pop_back();
+	rails.pop_back();
+	synced.pop_back();
+}
+
+WorldState Bodies::view() {
+	WorldState world;
+	world.count = world.capacity = size();
+	world.x = x.data();
+	world.y = y.data();
+	world.velX = velX.data();
+	world.velY = velY.data();
+	world.mass = mass.data();
+	world.radius = radius.data();
+	world.attractor = attractor.data();
+	world.active = active.data();
+	world.rails = rails.data();
+	world.railTime = railTime;
+	return world;
+}
+
+void Bodies::saveLast() {
+	lastX = x;
+	lastY = y;
+	std::fill(hasLast.begin(), hasLast.end(), 1);
+}
+
+void Bodies::beginInterpolation(double alpha) {
+	heldX = x;
+	heldY = y;
+	for (size_t i = 0; i < size(); i++) {
+		if (hasLast[i] && active[i]) {
+			x[i] = lastX[i] + (heldX[i] - lastX[i]) * alpha;
+			y[i] = lastY[i] + (heldY[i] - lastY[i]) * alpha;
+		}
+	}
+}
+
+void Bodies::endInterpolation() {
+	// only put back what beginInterpolation moved, drawing may have placed others itself
+	for (size_t i = 0; i < size(); i++) {
+		if (hasLast[i] && active[i]) {
+			x[i] = heldX[i];
+			y[i] = heldY[i];
+		}
+	}
+}
+
+void integrate() {
+	WorldState world = bodies.view();
+	integrate(world, delta, true);
+}
+
+void integrate(WorldState& world, double dt, bool threaded) {
+	double* x = world.x, * y = world.y;
+	const double* velX = world.velX, * velY = world.velY;
+	auto drift = [&](size_t from, size_t to) {
+		for (size_t i = from; i < to; i++) {
+			x[i] += velX[i] * dt;
+			y[i] += velY[i] * dt;
+		}
+	};
+	if (threaded) {
+		parallelFor(world.count, 4096, drift);
+	} else {
+		drift(0, world.count);
+	}
+}
+
+static void pull() {
+	if (barnesHut) {
+		applyTreeGravity();
+	} else {
+		applyGravity();
+	}
+}
+
+static constexpr double yoshidaW1 = 1.0 / (2.0 - 1.2599210498948732), yoshidaW0 = -1.2599210498948732 / (2.0 - 1.2599210498948732);
+static constexpr Scheme schemes[] = {
+	{"euler", 1, {1.0, 0.0}, {1.0}},
+	{"leapfrog", 1, {0.5, 0.5}, {1.0}},
+	{"yoshida", 3, {yoshidaW1 / 2.0, (yoshidaW0 + yoshidaW1) / 2.0, (yoshidaW0 + yoshidaW1) / 2.0, yoshidaW1 / 2.0}, {yoshidaW1, yoshidaW0, yoshidaW1}}
+};
+
+const Scheme& selectScheme(const std::string& name) {
+	for (const Scheme& scheme : schemes) {
+		if (name == scheme.name) {
+			return scheme;
+		}
+	}
+	return schemes[0];
+}
+
+static void advanceWith(const Scheme& scheme) {
+	double step = delta, drifted = 0.0;
+	for (int k = 0; k <= scheme.kicks; k++) {
+		if (scheme.drift[k] != 0.0) {
+			delta = step * scheme.drift[k];
+			integrate();
+			drifted += scheme.drift[k];
+			followRails(railTime + step * drifted);
+		}
+		if (k < scheme.kicks) {
+			delta = step * scheme.kick[k];
+			pull();
+		}
+	}
+	delta = step;
+	railTime += step;
+}
+
+void advance() {
+	advanceWith(selectScheme(integrator));
+}
+
+// kinetic plus potential energy of pairs with an attractor in them, the pairs gravity acts between
+static double totalEnergy(const WorldState& world) {
+	double kinetic = 0.0, potential = 0.0;
+	size_t n = world.count;
+	for (size_t i = 0; i < n; i++) {
+		if (!world.active[i]) {
+			continue;
+		}
+		kinetic += 0.5 * world.mass[i] * (world.velX[i] * world.velX[i] + world.velY[i] * world.velY[i]);
+		if (!world.attractor[i]) {
+			continue;
+		}
+		for (size_t j = 0; j < n; j++) {
+			// attractor pairs are counted once
+			if (j == i || !world.active[j] || (world.attractor[j] && j < i)) {
+				continue;
+			}
+			double dx = world.x[j] - world.x[i], dy = world.y[j] - world.y[i];
+			potential -= G * world.mass[i] * world.mass[j] / sqrt(dx * dx + dy * dy);
+		}
+	}
+	return kinetic + potential;
+}
+
+void testIntegrators(std::string& report, int steps, double stepDelta) {
+	Arena arena;
+	WorldState start = captureWorld(arena, 0);
+	double startEnergy = totalEnergy(start);
+	char line[256];
+	for (const Scheme& scheme : schemes) {
+		// every scheme gets its own fork of the same start, the live world isn't touched
+		WorldState world = fork(start, arena, 0);
+		double worst = 0.0, took = 0.0;
+		for (int i = 0; i < steps; i++) {
+			auto began = std::chrono::steady_clock::now();
+			advance(world, stepDelta, scheme);
+			took += std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+			worst = std::max(worst, fabs((totalEnergy(world) - startEnergy) / startEnergy));
+		}
+		double drift = (totalEnergy(world) - startEnergy) / startEnergy;
+		snprintf(line, sizeof(line), "%s: drift %.3e, worst %.3e, %.3fms per step\n", scheme.name, drift, worst, took * 1000.0 / std::max(steps, 1));
+		report.append(line);
+	}
+}
+
+}
@@ -0,0 +1,152 @@
+#include "broadphase.hpp"
+#include "entities.hpp"
+#include "globals.hpp"
+#include "jobs.hpp"
+#include "math.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace obf {
+
+struct Cell {
+	uint32_t start, count;
+};
+
+// all per entity, indexed like updateGroup
+static std::vector<double> reach;
+static std::vector<uint8_t> oversized;
+static std::vector<uint32_t> oversizedList;
+// (cell key, entity index) sorted by key, cells index into it
+static std::vector<std::pair<uint64_t, uint32_t>> entries;
+static std::unordered_map<uint64_t, Cell> cells;
+static double cellSize = 1.0;
+
+static inline int64_t cellOf(double v) {
+	return (int64_t)std::floor(v / cellSize);
+}
+static inline uint64_t cellKey(int64_t cx, int64_t cy) {
+	return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+// the original per-pair scan test
+static inline bool nearCandidate(Entity* a, Entity* b) {
+	double radii = a->radius() + b->radius();
+	return (dst2(a->x() - b->x(), a->y() - b->y()) - radii * radii) / std::max(0.5, dst2(b->velX() - a->velX(), b->velY() - a->velY())) < collideScanDistance2;
+}
+
+static void scanEntity(size_t i) {
+	Entity* a = updateGroup[i];
+	std::vector<Handle>& near = a->near;
+	near.clear();
+	if (oversized[i]) [[unlikely]] {
+		for (size_t j = 0; j < updateGroup.size(); j++) {
+			if (j != i && nearCandidate(a, updateGroup[j])) {
+				near.push_back(updateGroup[j]->handle);
+			}
+		}
+	} else {
+		double x = a->x(), y = a->y(), r = reach[i];
+		int64_t cx1 = cellOf(x - r), cy1 = cellOf(y - r), cx2 = cellOf(x + r), cy2 = cellOf(y + r);
+		for (int64_t cx = cx1; cx <= cx2; cx++) {
+			for (int64_t cy = cy1; cy <= cy2; cy++) {
+				auto it = cells.find(cellKey(cx, cy));
+				if (it == cells.end()) {
+					continue;
+				}
+				Cell cell = it->second;
+				for (uint32_t k = cell.start; k < cell.start + cell.count; k++) {
+					uint32_t j = entries[k].second;
+					if (j == i) [[unlikely]] {
+						continue;
+					}
+					Entity* b = updateGroup[j];
+					double bx = b->x(), by = b->y(), br = reach[j];
+					// boxes touching several shared cells only get tested in the one holding the corner of their overlap
+					double ox = std::max(x - r, bx - br), oy = std::max(y - r, by - br);
+					if (ox > std::min(x + r, bx + br) || oy > std::min(y + r, by + br) || cellOf(ox) != cx || cellOf(oy) != cy) {
+						continue;
+					}
+					if (nearCandidate(a, b)) {
+						near.push_back(b->handle);
+					}
+				}
+			}
+		}
+		for (uint32_t j : oversizedList) {
+			if (nearCandidate(a, updateGroup[j])) {
+				near.push_back(updateGroup[j]->handle);
+			}
+		}
+	}
+	a->lastCollideScan = globalTime;
+}
+
+void scanCollisions() {
+	bool full = globalTime - lastFullScan > collideScanSpacing;
+	size_t n = updateGroup.size();
+	std::vector<uint32_t> due;
+	for (size_t i = 0; i < n; i++) {
+		if (full || globalTime - updateGroup[i]->lastCollideScan > collideScanSpacing) {
+			due.push_back(i);
+		}
+	}
+	if (due.empty()) {
+		return;
+	}
+	if (full) {
+		lastFullScan = globalTime;
+	}
+
+	// pairs passing the scan test are always closer than the sum of these, no matter their relative velocity
+	double scanTime = sqrt(collideScanDistance2);
+	reach.resize(n);
+	parallelFor(n, 1024, [scanTime](size_t from, size_t to) {
+		for (size_t i = from; i < to; i++) {
+			Entity* e = updateGroup[i];
+			reach[i] = e->radius() + scanTime * (dst(e->velX(), e->velY()) + sqrt(0.5) * 0.5);
+		}
+	});
+
+	// cells fit a typical entity, the few much bigger ones (stars, big planets) are tested against everything instead
+	std::vector<double> sorted(reach);
+	std::nth_element(sorted.begin(), sorted.begin() + n / 2, sorted.end());
+	cellSize = std::max(1.0, sorted[n / 2] * 2.0);
+	oversized.assign(n, 0);
+	oversizedList.clear();
+	entries.clear();
+	for (size_t i = 0; i < n; i++) {
+		if (reach[i] > cellSize * 2.0) {
+			oversized[i] = 1;
+			oversizedList.push_back(i);
+			continue;
+		}
+		Entity* e = updateGroup[i];
+		int64_t cx1 = cellOf(e->x() - reach[i]), cy1 = cellOf(e->y() - reach[i]), cx2 = cellOf(e->x() + reach[i]), cy2 = cellOf(e->y() + reach[i]);
+		for (int64_t cx = cx1; cx <= cx2; cx++) {
+			for (int64_t cy = cy1; cy <= cy2; cy++) {
+				entries.push_back({cellKey(cx, cy), i});
+			}
+		}
+	}
+	std::sort(entries.begin(), entries.end());
+	cells.clear();
+	for (uint32_t k = 0; k < entries.size(); k++) {
+		if (k == 0 || entries[k].first != entries[k - 1].first) {
+			cells[entries[k].first] = {k, 0};
+		}
+		cells[entries[k].first].count++;
+	}
+
+	parallelFor(due.size(), 16, [&due](size_t from, size_t to) {
+		for (size_t k = from; k < to; k++) {
+			scanEntity(due[k]);
+		}
+	});
+}
+
+}
@@ -0,0 +1,297 @@
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace obf {
+
+// per entity flags saying which fields follow
+static constexpr uint8_t SyncX = 1, SyncY = 2, SyncVelX = 4, SyncVelY = 8, SyncRotation = 16,
+	SyncNew = 32, // no base to go off, every field is sent whole
+	SyncCoarse = 64; // a byte with the coarseness of the position fields follows
+
+static void putVarint(std::string& out, uint64_t v) {
+	while (v >= 0x80) {
+		out.push_back((char)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((char)v);
+}
+
+static inline uint64_t zigzag(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+static inline int64_t unzigzag(uint64_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+struct Reader {
+	const std::string& data;
+	size_t pos = 0;
+	bool ok = true;
+
+	uint8_t byte() {
+		if (pos >= data.size()) [[unlikely]] {
+			ok = false;
+			return 0;
+		}
+		return (uint8_t)data[pos++];
+	}
+	uint64_t varint() {
+		uint64_t v = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t b = byte();
+			v |= (uint64_t)(b & 0x7f) << shift;
+			if (!(b & 0x80)) {
+				return v;
+			}
+		}
+		ok = false;
+		return 0;
+	}
+	int64_t signedVarint() {
+		return unzigzag(varint());
+	}
+};
+
+// where base would be after elapsed time if it kept its velocity
+static inline int64_t predict(int64_t pos, int64_t vel, int64_t elapsed) {
+	return pos + ((vel * elapsed) >> syncMoveShift);
+}
+
+// rounds to a multiple of 2^k
+static inline int64_t roundShift(int64_t v, int k) {
+	return k ? (v + ((int64_t)1 << (k - 1))) >> k : v;
+}
+
+SyncState quantizeState(uint32_t id, double x, double y, double velX, double velY, double rotation) {
+	SyncState s;
+	s.id = id;
+	s.x = llround(x * syncPosScale);
+	s.y = llround(y * syncPosScale);
+	s.velX = llround(velX * syncVelScale);
+	s.velY = llround(velY * syncVelScale);
+	s.rotation = (uint16_t)llround(fmod(rotation, 360.0) * (65536.0 / 360.0));
+	return s;
+}
+
+void dequantizeState(const SyncState& s, double& x, double& y, double& velX, double& velY, double& rotation) {
+	x = s.x / syncPosScale;
+	y = s.y / syncPosScale;
+	velX = s.velX / syncVelScale;
+	velY = s.velY / syncVelScale;
+	rotation = s.rotation * (360.0 / 65536.0);
+}
+
+void encodeFrame(std::string& out, const SyncFrame* base, SyncFrame& frame) {
+	out.clear();
+	int64_t elapsed = 0;
+	if (base) {
+		elapsed = frame.time - base->time;
+		putVarint(out, zigzag(elapsed));
+	}
+	putVarint(out, frame.states.size());
+	size_t b = 0;
+	uint32_t lastID = 0;
+	for (SyncState& s : frame.states) {
+		putVarint(out, s.id - lastID);
+		lastID = s.id;
+		const SyncState* old = nullptr;
+		if (base) {
+			while (b < base->states.size() && base->states[b].id < s.id) {
+				b++;
+			}
+			if (b < base->states.size() && base->states[b].id == s.id) {
+				old = &base->states[b];
+			}
+		}
+		if (!old) {
+			out.push_back(SyncNew);
+			putVarint(out, zigzag(s.x));
+			putVarint(out, zigzag(s.y));
+			putVarint(out, zigzag(s.velX));
+			putVarint(out, zigzag(s.velY));
+			putVarint(out, s.rotation);
+			continue;
+		}
+		int k = std::min((int)s.coarseness, maxCoarseness);
+		int64_t predX = predict(old->x, old->velX, elapsed), predY = predict(old->y, old->velY, elapsed);
+		int64_t dx = roundShift(s.x - predX, k), dy = roundShift(s.y - predY, k);
+		// keep what the decoder will end up with so this frame can be a base later
+		s.x = predX + dx * ((int64_t)1 << k);
+		s.y = predY + dy * ((int64_t)1 << k);
+		int64_t dvx = s.velX - old->velX, dvy = s.velY - old->velY;
+		int16_t drot = (int16_t)(uint16_t)(s.rotation - old->rotation);
+		uint8_t flags = (dx ? SyncX : 0) | (dy ? SyncY : 0) | (dvx ? SyncVelX : 0) | (dvy ? SyncVelY : 0) | (drot ? SyncRotation : 0);
+		if (k && (dx || dy)) {
+			flags |= SyncCoarse;
+		}
+		out.push_back(flags);
+		if (flags & SyncCoarse) {
+			out.push_back((char)k);
+		}
+		if (dx) {
+			putVarint(out, zigzag(dx));
+		}
+		if (dy) {
+			putVarint(out, zigzag(dy));
+		}
+		if (dvx) {
+			putVarint(out, zigzag(dvx));
+		}
+		if (dvy) {
+			putVarint(out, zigzag(dvy));
+		}
+		if (drot) {
+			putVarint(out, zigzag(drot));
+		}
+	}
+}
+
+bool decodeFrame(const std::string& data, const SyncFrame* base, SyncFrame& frame) {
+	Reader in{data};
+	int64_t elapsed = 0;
+	// only time differences matter, the first frame can start anywhere
+	frame.time = 0;
+	if (base) {
+		elapsed = in.signedVarint();
+		frame.time = base->time + elapsed;
+	}
+	uint64_t count = in.varint();
+	// every entity takes at least 2 bytes, don't let a bad count allocate forever
+	if (!in.ok || count > data.size()) [[unlikely]] {
+		return false;
+	}
+	frame.states.resize(count);
+	size_t b = 0;
+	uint32_t lastID = 0;
+	for (SyncState& s : frame.states) {
+		s.id = lastID + (uint32_t)in.varint();
+		lastID = s.id;
+		uint8_t flags = in.byte();
+		if (flags & SyncNew) {
+			s.x = in.signedVarint();
+			s.y = in.signedVarint();
+			s.velX = in.signedVarint();
+			s.velY = in.signedVarint();
+			s.rotation = (uint16_t)in.varint();
+			continue;
+		}
+		const SyncState* old = nullptr;
+		if (base) {
+			while (b < base->states.size() && base->states[b].id < s.id) {
+				b++;
+			}
+			if (b < base->states.size() && base->states[b].id == s.id) {
+				old = &base->states[b];
+			}
+		}
+		if (!old) [[unlikely]] {
+			return false;
+		}
+		int k = flags & SyncCoarse ? in.byte() : 0;
+		if (k > maxCoarseness) [[unlikely]] {
+			return false;
+		}
+		int64_t dx = flags & SyncX ? in.signedVarint() : 0,
+			dy = flags & SyncY ? in.signedVarint() : 0;
+		s.x = predict(old->x, old->velX, elapsed) + dx * ((int64_t)1 << k);
+		s.y = predict(old->y, old->velY, elapsed) + dy * ((int64_t)1 << k);
+		s.velX = old->velX + (flags & SyncVelX ? in.signedVarint() : 0);
+		s.velY = old->velY + (flags & SyncVelY ? in.signedVarint() : 0);
+		s.rotation = old->rotation + (uint16_t)(flags & SyncRotation ? in.signedVarint() : 0);
+	}
+	return in.ok && in.pos == data.size();
+}
+
+bool testCodec(std::string& report) {
+	std::mt19937_64 rng(7817);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	// bodies on circular orbits, like planets and ships far out
+	struct Orbit {
+		double radius, phase, speed, spin;
+	};
+	const size_t count = 500;
+	std::vector<Orbit> orbits(count);
+	for (Orbit& o : orbits) {
+		o.radius = 1.0e3 * pow(1.0e4, unit(rng));
+		o.phase = unit(rng) * 2.0 * M_PI;
+		// radians per second, kepler-ish so far orbits are slower
+		o.speed = (unit(rng) < 0.5 ? 1.0 : -1.0) * 2.0e3 / pow(o.radius, 1.5);
+		o.spin = unit(rng) < 0.2 ? unit(rng) * 720.0 : 0.0;
+	}
+	SyncFrame frames[syncHistory], decoded[syncHistory];
+	size_t rawBytes = 0, sentBytes = 0, checked = 0;
+	double maxPosError = 0.0, maxVelError = 0.0, maxRotError = 0.0;
+	double time = 0.0;
+	std::string data;
+	bool ok = true;
+	for (size_t f = 0; f < 400 && ok; f++) {
+		time += 0.1 + (unit(rng) - 0.5) * 0.02;
+		SyncFrame& frame = frames[f % syncHistory];
+		frame.tick = f;
+		frame.time = llround(time * syncTimeScale);
+		frame.states.clear();
+		for (size_t i = 0; i < count; i++) {
+			// entities leave and come back, like with culling
+			if (unit(rng) < 0.05) {
+				continue;
+			}
+			const Orbit& o = orbits[i];
+			double a = o.phase + o.speed * time;
+			double x = o.radius * cos(a), y = o.radius * sin(a);
+			// velocities are per tick
+			double velX = -o.radius * o.speed * sin(a) / 60.0, velY = o.radius * o.speed * cos(a) / 60.0;
+			SyncState& s = frame.states.emplace_back(quantizeState(i * 3 + 1, x, y, velX, velY, o.spin * time));
+			s.coarseness = unit(rng) < 0.5 ? 0 : rng() % (maxCoarseness + 1);
+		}
+		// acks lag a few frames behind, sometimes there's nothing to go off
+		size_t lag = 1 + rng() % 4;
+		bool hasBase = f >= lag && unit(rng) > 0.05;
+		const SyncFrame* base = hasBase ? &frames[(f - lag) % syncHistory] : nullptr;
+		encodeFrame(data, base, frame);
+		SyncFrame& out = decoded[f % syncHistory];
+		const SyncFrame* decodeBase = hasBase ? &decoded[(f - lag) % syncHistory] : nullptr;
+		if (!decodeFrame(data, decodeBase, out) || out.states.size() != frame.states.size()) {
+			report.append("frame ").append(std::to_string(f)).append(" failed to decode\n");
+			ok = false;
+			break;
+		}
+		rawBytes += frame.states.size() * (4 + 5 * 8);
+		sentBytes += data.size();
+		for (size_t i = 0; i < out.states.size(); i++) {
+			const SyncState& s = frame.states[i], & d = out.states[i];
+			if (s.id != d.id || s.x != d.x || s.y != d.y || s.velX != d.velX || s.velY != d.velY || s.rotation != d.rotation) {
+				report.append("frame ").append(std::to_string(f)).append(" decoded differently than encoded\n");
+				ok = false;
+				break;
+			}
+			const Orbit& o = orbits[(s.id - 1) / 3];
+			double a = o.phase + o.speed * time;
+			double x, y, velX, velY, rotation;
+			dequantizeState(d, x, y, velX, velY, rotation);
+			// rounding to the grid, then coarse positions are off by at most half a step more
+			double posBound = (0.5 + (s.coarseness ? (double)((int64_t)1 << (s.coarseness - 1)) : 0.0)) / syncPosScale * (1.0 + 1.0e-9);
+			double posError = std::max(fabs(x - o.radius * cos(a)), fabs(y - o.radius * sin(a)));
+			double velError = std::max(fabs(velX + o.radius * o.speed * sin(a) / 60.0), fabs(velY - o.radius * o.speed * cos(a) / 60.0));
+			double rotError = fabs(remainder(rotation - o.spin * time, 360.0));
+			if (posError > posBound || velError > 0.5 / syncVelScale * (1.0 + 1.0e-9) || rotError > 180.0 / 65536.0 * (1.0 + 1.0e-6)) {
+				report.append("entity ").append(std::to_string(s.id)).append(" in frame ").append(std::to_string(f)).append(" is out of bounds\n");
+				ok = false;
+				break;
+			}
+			maxPosError = std::max(maxPosError, posError);
+			maxVelError = std::max(maxVelError, velError);
+			maxRotError = std::max(maxRotError, rotError);
+			checked++;
+		}
+	}
+	char line[256];
+	snprintf(line, sizeof(line), "%s: %zu states, %zu bytes instead of %zu (%.1fx smaller), max error pos %g vel %g rot %g\n",
+		ok ? "passed" : "FAILED", checked, sentBytes, rawBytes, sentBytes ? (double)rawBytes / sentBytes : 0.0, maxPosError, maxVelError, maxRotError);
+	report.append(line);
+	return ok;
+}
+
+}
@@ -1,11 +1,15 @@
 #include "camera.hpp"
 #include "entities.hpp"
 #include "globals.hpp"
+#include "idmap.hpp"
 #include "math.hpp"
 #include "net.hpp"
+#include "render.hpp"
 #include "types.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -21,14 +25,14 @@ bool operator ==(movement& mov1, movement& mov2) {
 
 void setupShip(Entity* ship) {
 	Attractor* planet = planets[(int)rand_f(0, planets.size())];
-	double spawnDst = planet->radius + rand_f(2000.f, 6000.f);
+	double spawnDst = planet->radius() + rand_f(2000.f, 6000.f);
 	float spawnAngle = rand_f(-PI, PI);
-	ship->setPosition(planet->x + spawnDst * std::cos(spawnAngle), planet->y + spawnDst * std::sin(spawnAngle));
-	double vel = sqrt(G * planet->mass / spawnDst);
-	ship->setVelocity(planet->velX + vel * std::cos(spawnAngle + PI / 2.0), planet->velY + vel * std::sin(spawnAngle + PI / 2.0));
+	ship->setPosition(planet->x() + spawnDst * std::cos(spawnAngle), planet->y() + spawnDst * std::sin(spawnAngle));
+	double vel = sqrt(G * planet->mass() / spawnDst);
+	ship->setVelocity(planet->velX() + vel * std::cos(spawnAngle + PI / 2.0), planet->velY() + vel * std::sin(spawnAngle + PI / 2.0));
 }
 
-int generateOrbitingPlanets(int amount, double x, double y, double velx, double vely, double parentmass, double minradius, double maxradius, double spawnDst) {
+int generateOrbitingPlanets(int amount, double x, double y, double velx, double vely, double parentmass, double minradius, double maxradius, double spawnDst, Attractor* parent = nullptr) {
 	int totalMoons = 0;
 	double maxFactor = sqrt(pow(gen_minNextRadius * gen_maxNextRadius, amount * 0.5) * spawnDst);
 	for (int i = 0; i < amount; i++) {
@@ -42,9 +46,12 @@ int generateOrbitingPlanets(int amount, double x, double y, double velx, double
 		double vel = sqrt(G * parentmass / spawnDst);
 		planet->addVelocity(velx + vel * std::cos(spawnAngle + PI / 2.0), -vely - vel * std::sin(spawnAngle + PI / 2.0));
 		planet->setColor((int)rand_f(64.f, 255.f), (int)rand_f(64.f, 255.f), (int)rand_f(64.f, 255.f));
+		if (onRails) {
+			putOnRails(planet, parent, parentmass);
+		}
 		int moons = (int)(rand_f(0.f, 1.f) * radius * radius / (gen_moonFactor * gen_moonFactor));
 		obf::planets.push_back(planet);
-		totalMoons += moons + generateOrbitingPlanets(moons, planet->x, planet->y, planet->velX, planet->velY, planet->mass, gen_minMoonRadius, planet->radius * gen_maxMoonRadiusFrac, planet->radius * (1.0 + rand_f(gen_minMoonDistance, gen_minMoonDistance + pow(gen_maxMoonDistance, std::min(1.0, 0.5 / (planet->radius / gen_maxPlanetRadius))))));
+		totalMoons += moons + generateOrbitingPlanets(moons, planet->x(), planet->y(), planet->velX(), planet->velY(), planet->mass(), gen_minMoonRadius, planet->radius() * gen_maxMoonRadiusFrac, planet->radius() * (1.0 + rand_f(gen_minMoonDistance, gen_minMoonDistance + pow(gen_maxMoonDistance, std::min(1.0, 0.5 / (planet->radius() / gen_maxPlanetRadius))))), planet);
 	}
 	return totalMoons;
 }
@@ -75,8 +82,8 @@ void generateSystem() {
 	if (starsN > 1) {
 		double aX = 0.0, aY = 0.0;
 		for (int i = 1; i < starsN; i++) {
-			double xdiff = stars[i]->x - stars[0]->x, ydiff = stars[i]->y - stars[0]->y,
-			factor = stars[i]->mass * G / pow(xdiff * xdiff + ydiff * ydiff, 1.5);
+			double xdiff = stars[i]->x() - stars[0]->x(), ydiff = stars[i]->y() - stars[0]->y(),
+			factor = stars[i]->mass() * G / pow(xdiff * xdiff + ydiff * ydiff, 1.5);
 			aX += factor * xdiff;
 			aY += factor * ydiff;
 		}
@@ -92,6 +99,90 @@ void generateSystem() {
 	printf("Generated system: %u stars, %u planets, %u moons\n", starsN, planets, generateOrbitingPlanets(planets, 0.0, 0.0, 0.0, 0.0, starsMass, gen_minPlanetRadius, gen_maxPlanetRadius, spawnDst));
 }
 
+void putOnRails(Attractor* e, Attractor* parent, double parentMass) {
+	double x = e->x(), y = e->y(), velX = e->velX(), velY = e->velY(), mu = G * parentMass;
+	if (parent) {
+		x -= parent->x();
+		y -= parent->y();
+		velX -= parent->velX();
+		velY -= parent->velY();
+		// the parent moves too, so the pair orbits each other as if with both masses
+		mu += G * e->mass();
+	}
+	if (!fitOrbit(e->orbit, x, y, velX, velY, mu, railTime)) {
+		return;
+	}
+	e->railParent = parent ? parent->id : noRailParent;
+	e->railVelX = e->velX();
+	e->railVelY = e->velY();
+	bodies.rails[e->body] = 1;
+}
+
+// relative velocity change that counts as being hit, gravity can't do it since rails bodies aren't pulled
+constexpr double derailThreshold = 1.0e-6;
+
+static void placeOnRails(Attractor* e, double time, uint32_t pass) {
+	if (e->railPass == pass) {
+		return;
+	}
+	e->railPass = pass;
+	double parentX = 0.0, parentY = 0.0, parentVelX = 0.0, parentVelY = 0.0;
+	if (e->railParent != noRailParent) {
+		Entity* parent = entityMap.get(e->railParent);
+		if (!parent) [[unlikely]] {
+			if (headless) {
+				derail(e);
+			}
+			return;
+		}
+		// moons go after their planet
+		if (bodies.rails[parent->body]) {
+			placeOnRails((Attractor*)parent, time, pass);
+		}
+		parentX = parent->x();
+		parentY = parent->y();
+		parentVelX = parent->velX();
+		parentVelY = parent->velY();
+	}
+	if (headless) {
+		double hit = dst(e->velX() - e->railVelX, e->velY() - e->railVelY);
+		if (hit > derailThreshold * dst(e->railVelX - parentVelX, e->railVelY - parentVelY)) [[unlikely]] {
+			derail(e);
+			return;
+		}
+	}
+	double x, y, velX, velY;
+	orbitState(e->orbit, time, x, y, velX, velY);
+	e->setPosition(parentX + x, parentY + y);
+	e->setVelocity(parentVelX + velX, parentVelY + velY);
+	e->railVelX = e->velX();
+	e->railVelY = e->velY();
+}
+
+void followRails(double time) {
+	static uint32_t pass = 0;
+	pass++;
+	for (Entity* e : updateGroup) {
+		if (bodies.rails[e->body]) {
+			placeOnRails((Attractor*)e, time, pass);
+		}
+	}
+}
+
+void derail(Attractor* e) {
+	bodies.rails[e->body] = 0;
+	if (debug) {
+		printf("Entity %u left its rails\n", e->id);
+	}
+	if (headless) {
+		for (Player* p : playerGroup) {
+			sf::Packet derailPacket;
+			derailPacket << Packets::Derail << e->id << e->x() << e->y() << e->velX() << e->velY();
+			p->send(derailPacket);
+		}
+	}
+}
+
 std::string Player::name() {
 	if (username.size()) return username;
 
@@ -117,7 +208,7 @@ Player::~Player() {
 	std::cout << sendMessage << std::endl;
 	chatPacket << Packets::Chat << sendMessage;
 	for (Player* p : playerGroup) {
-		p->tcpSocket.send(chatPacket);
+		p->send(chatPacket);
 	}
 	entityDeleteBuffer.push_back(entity);
 }
@@ -125,41 +216,25 @@ Player::~Player() {
 Entity::Entity() {
 	id = nextID;
 	nextID++;
-	updateGroup.push_back(this);
-	if (!headless) {
-		ghost = simulating;
-	}
+	entityMap.put(id, this);
+	body = bodies.add(this);
+	handle = registry.add(this);
+	addToGroup(this);
 }
 
 Entity::~Entity() noexcept {
 	if (debug) {
 		printf("Deleting entity id %u\n", this->id);
 	}
+	// near lists, owners and simRelBody hold handles, which go stale here instead of having to be searched for
+	registry.remove(handle);
 	if (!fullclearing) {
-		for (size_t i = 0; i < updateGroup.size(); i++) {
-			Entity* e = updateGroup[i];
-			if (e == this) [[unlikely]] {
-				updateGroup[i] = updateGroup[updateGroup.size() - 1];
-				updateGroup.pop_back();
-			} else {
-				for (size_t i = 0; i < e->near.size(); i++){
-					if (e->near[i] == this) [[unlikely]] {
-						e->near[i] = e->near[e->near.size() - 1];
-						e->near.pop_back();
-						break;
-					}
-				}
-				if (e->simRelBody == this) [[unlikely]] {
-					e->simRelBody = nullptr;
-				}
-				if (e->type() == Entities::Projectile && ((Projectile*)e)->owner == this) {
-					((Projectile*)e)->owner = nullptr;
-				}
-			}
-		}
+		removeFromGroup(this);
 	}
 
-	if (!fullclearing) {
+	// type() is gone by now, but only attractors can be stars or planets
+	bool attractor = bodies.attractor[body];
+	if (!fullclearing && attractor) {
 		for (size_t i = 0; i < stars.size(); i++) {
 			Entity* e = stars[i];
 			if (e == this) [[unlikely]] {
@@ -174,9 +249,9 @@ Entity::~Entity() noexcept {
 		for (Player* p : playerGroup) {
 			sf::Packet despawnPacket;
 			despawnPacket << Packets::DeleteEntity << this->id;
-			p->tcpSocket.send(despawnPacket);
+			p->send(despawnPacket);
 		}
-		if (!fullclearing) {
+		if (!fullclearing && attractor) {
 			for (size_t i = 0; i < planets.size(); i++) {
 				Entity* e = planets[i];
 				if (e == this) [[unlikely]] {
@@ -194,6 +269,14 @@ Entity::~Entity() noexcept {
 			trajectoryRef = nullptr;
 		}
 	}
+	entityMap.remove(id, this);
+	bodies.remove(body);
+}
+
+void Entity::setID(uint32_t id) {
+	entityMap.remove(this->id, this);
+	this->id = id;
+	entityMap.put(id, this);
 }
 
 void Entity::syncCreation() {
@@ -201,39 +284,23 @@ void Entity::syncCreation() {
 		sf::Packet packet;
 		packet << Packets::CreateEntity;
 		this->loadCreatePacket(packet);
-		p->tcpSocket.send(packet);
+		p->send(packet);
 	}
 }
 
 void Entity::control(movement& cont) {}
 void Entity::update1() {
-	x += velX * delta;
-	y += velY * delta;
+	// position is integrated for all bodies at once by integrate()
 	rotation += rotateVel * delta;
 }
 void Entity::update2() {
-	if (globalTime - lastCollideScan > collideScanSpacing) [[unlikely]] {
-		size_t i = 0;
-		for (Entity* e : updateGroup) {
-			if (e == this || ((e->ghost || ghost) && type() == Entities::Triangle && e->type() == Entities::Triangle)) [[unlikely]] {
-				continue;
-			}
-			if ((dst2(abs(x - e->x), abs(y - e->y)) - (radius + e->radius) * (radius + e->radius)) / std::max(0.5, dst2(e->velX - velX, e->velY - velY)) < collideScanDistance2) {
-				if(i == near.size()) {
-					near.push_back(e);
-				} else {
-					near[i] = e;
-				}
-				i++;
-			}
-		}
-		if (i < near.size()) {
-			near.erase(near.begin() + i, near.begin() + near.size());
+	for (Handle h : near) {
+		Entity* e = registry.get(h);
+		// deleted since the last scan, or inactive
+		if (!e || !bodies.active[e->body]) [[unlikely]] {
+			continue;
 		}
-		lastCollideScan = globalTime;
-	}
-	for (Entity* e : near) {
-		if (dst2(x - e->x, y - e->y) <= (radius + e->radius) * (radius + e->radius) && !(ghost && e->ghost)) [[unlikely]] {
+		if (dst2(x() - e->x(), y() - e->y()) <= (radius() + e->radius()) * (radius() + e->radius())) [[unlikely]] {
 			collide(e, true);
 			if (type() == Entities::Attractor) {
 				if (((Attractor*)this)->star && e->type() == Entities::Triangle) [[unlikely]] {
@@ -249,23 +316,21 @@ void Entity::update2() {
 							break;
 						}
 					}
-					if (!found && (headless || simulating)) {
+					if (!found && headless) {
 						entityDeleteBuffer.push_back(e);
 					}
 					break;
 				} else if (e->type() == Entities::Attractor) [[unlikely]] {
-					if (mass >= e->mass && (headless || simulating)) {
-						if (!simulating) {
-							printf("Planetary collision: %u absorbed %u\n", id, e->id);
-						}
-						double radiusMul = sqrt((mass + e->mass) / mass);
-						mass += e->mass;
-						radius *= radiusMul;
+					if (mass() >= e->mass() && headless) {
+						printf("Planetary collision: %u absorbed %u\n", id, e->id);
+						double radiusMul = sqrt((mass() + e->mass()) / mass());
+						mass() += e->mass();
+						radius() *= radiusMul;
 						if (headless) {
 							sf::Packet collisionPacket;
-							collisionPacket << Packets::PlanetCollision << id << mass << radius;
+							collisionPacket << Packets::PlanetCollision << id << mass() << radius();
 							for (Player* p : playerGroup) {
-								p->tcpSocket.send(collisionPacket);
+								p->send(collisionPacket);
 							}
 						}
 						entityDeleteBuffer.push_back(e);
@@ -281,307 +346,297 @@ void Entity::update2() {
 }
 
 void Entity::draw() {
-	sf::Color trajColor(color[0], color[1], color[2]);
-	if (lastTrajectoryRef && trajectory.size() > trajectoryOffset) [[likely]] {
-		size_t to = trajectory.size() - trajectoryOffset;
-		sf::VertexArray lines(sf::LineStrip, to);
-		float lastAlpha = 255;
-		float decBy = (255.f - 64.f) / (to);
-		for (size_t i = 0; i < to; i++){
-			Point point = trajectory[i + trajectoryOffset];
-			lines[i].position = sf::Vector2f(lastTrajectoryRef->x + point.x + drawShiftX, lastTrajectoryRef->y + point.y + drawShiftY);
-			lines[i].color = trajColor;
-			lines[i].color.a = (uint8_t)lastAlpha;
-			lastAlpha -= decBy;
-		}
-		window->draw(lines);
+	if (lastTrajectoryRef && trajectoryLine != noLine) [[likely]] {
+		// points are only predicted every now and then, skip the ones already passed
+		size_t from = std::partition_point(trajectory.begin(), trajectory.end(), [](const Point& p) { return p.time < globalTime; }) - trajectory.begin();
+		trajectoryLines.draw(trajectoryLine, from, lastTrajectoryRef->x() + drawShiftX, lastTrajectoryRef->y() + drawShiftY);
 	}
 }
 
 void Entity::collide(Entity* with, bool collideOther) {
-	if (debug && dst2(with->velX - velX, with->velY - velY) > 0.1) [[unlikely]] {
+	if (debug && dst2(with->velX() - velX(), with->velY() - velY()) > 0.1) [[unlikely]] {
 		printf("collision: %u-%u\n", id, with->id);
 	}
 	if (with->type() == Entities::Projectile) {
 		return;
 	}
-	double dVx = velX - with->velX, dVy = with->velY - velY;
-	double inHeading = std::atan2(y - with->y, with->x - x);
+	double dVx = velX() - with->velX(), dVy = with->velY() - velY();
+	double inHeading = std::atan2(y() - with->y(), with->x() - x());
 	double velHeading = std::atan2(dVy, dVx);
-	double massFactor = std::min(with->mass / mass, 1.0);
+	double massFactor = std::min(with->mass() / mass(), 1.0);
 	double factor = massFactor * std::cos(std::abs(deltaAngleRad(inHeading, velHeading))) * collideRestitution;
 	if (factor < 0.0) {
 		return;
 	}
 	double vel = dst(dVx, dVy);
 	double inX = std::cos(inHeading), inY = std::sin(inHeading);
-	velX -= vel * inX * factor + massFactor * friction * delta * dVx;
-	velY += vel * inY * factor + massFactor * friction * delta * dVy;
-	x = (x + (with->x - (radius + with->radius) * inX) * massFactor) / (1.0 + massFactor);
-	y = (y + (with->y + (radius + with->radius) * inY) * massFactor) / (1.0 + massFactor);
+	velX() -= vel * inX * factor + massFactor * friction * delta * dVx;
+	velY() += vel * inY * factor + massFactor * friction * delta * dVy;
+	x() = (x() + (with->x() - (radius() + with->radius()) * inX) * massFactor) / (1.0 + massFactor);
+	y() = (y() + (with->y() + (radius() + with->radius()) * inY) * massFactor) / (1.0 + massFactor);
 	if (collideOther) {
 		with->collide(this, false);
 	}
 }
 
-void Entity::simSetup() {
-	resX = x;
-	resY = y;
-	resVelX = velX;
-	resVelY = velY;
-	resRotation = rotation;
-	resRotateVel = rotateVel;
-	resMass = mass;
-	resRadius = radius;
-	resNear = near;
-	resCollideScan = lastCollideScan;
-}
-void Entity::simReset() {
-	x = resX;
-	y = resY;
-	velX = resVelX;
-	velY = resVelY;
-	rotation = resRotation;
-	rotateVel = resRotateVel;
-	mass = resMass;
-	radius = resRadius;
-	near = resNear;
-	lastCollideScan = resCollideScan;
-}
-
 Quad& Quad::getChild(uint8_t at) {
+	// growing the quadtree moves every node, so only touch this one through its index afterwards
+	size_t self = this - quadtree;
 	if (children[at] == 0) {
 		if (quadsConstructed >= quadsAllocated) {
-			int previouslyAllocated = quadsAllocated;
-			quadsAllocated = (int)(quadsAllocated * extraQuadAllocation);
-			Quad* newQuadtree = (Quad*)malloc(quadsAllocated * sizeof(Quad));
-			memcpy(newQuadtree, quadtree, previouslyAllocated * sizeof(Quad));
-			delete quadtree;
-			quadtree = newQuadtree;
+			quadsAllocated = (int)(quadsAllocated * extraQuadAllocation) + 1;
+			quadtree = (Quad*)realloc(quadtree, quadsAllocated * sizeof(Quad));
 		}
+		Quad& parent = quadtree[self];
 		Quad& child = quadtree[quadsConstructed];
 		child = Quad();
-		double halfsize = size * 0.5;
-		child.x = at == 1 || at == 3 ? x + halfsize : x;
-		child.y = at > 1 ? y + halfsize : y;
+		double halfsize = parent.size * 0.5;
+		child.x = at == 1 || at == 3 ? parent.x + halfsize : parent.x;
+		child.y = at > 1 ? parent.y + halfsize : parent.y;
 		child.size = halfsize;
-		children[at] = quadsConstructed;
+		parent.children[at] = quadsConstructed;
 		quadsConstructed++;
 		return child;
 	}
 	return quadtree[children[at]];
 }
-void Quad::put(Entity* e) {
-	mass += e->mass;
-	if (used) {
-		getChild((e->x > x + size * 0.5) + 2 * (e->y > y + size * 0.5)).put(e);
-		if (entity) {
-			getChild((entity->x > x + size * 0.5) + 2 * (entity->y > y + size * 0.5)).put(entity);
-			entity = nullptr;
-		}
-	} else {
-		entity = e;
+void Quad::put(uint32_t b) {
+	size_t self = this - quadtree;
+	double bx = bodies.x[b], by = bodies.y[b], bmass = bodies.mass[b];
+	if (mass + bmass > 0.0) [[likely]] {
+		comX = (comX * mass + bx * bmass) / (mass + bmass);
+		comY = (comY * mass + by * bmass) / (mass + bmass);
+	}
+	mass += bmass;
+	if (!used) {
+		body = b;
 		used = true;
+		return;
+	}
+	if (size < minQuadSize) [[unlikely]] {
+		// bodies on top of each other would split forever, keep them lumped together here
+		return;
+	}
+	uint32_t moved = body;
+	body = noBody;
+	getChild((bx > x + size * 0.5) + 2 * (by > y + size * 0.5)).put(b);
+	if (moved != noBody) {
+		Quad& quad = quadtree[self];
+		quad.getChild((bodies.x[moved] > quad.x + quad.size * 0.5) + 2 * (bodies.y[moved] > quad.y + quad.size * 0.5)).put(moved);
+	}
+}
+void Quad::pull(uint32_t b) {
+	if (body == b || mass == 0.0) {
+		return;
+	}
+	double xdiff = comX - bodies.x[b], ydiff = comY - bodies.y[b];
+	double dist2 = dst2(xdiff, ydiff);
+	if (body != noBody || size * size < barnesHutTheta * barnesHutTheta * dist2) {
+		if (dist2 == 0.0) [[unlikely]] {
+			return;
+		}
+		double factor = delta * G * mass / (dist2 * sqrt(dist2));
+		bodies.velX[b] += xdiff * factor;
+		bodies.velY[b] += ydiff * factor;
+		return;
+	}
+	for (uint32_t child : children) {
+		if (child) {
+			quadtree[child].pull(b);
+		}
 	}
 }
 
-Triangle::Triangle() : Entity() {
-	mass = 20000.0;
-	radius = 16.0;
-	if (!headless && !simulating) {
-		shape = std::make_unique<sf::CircleShape>(radius, 3);
-		shape->setOrigin(radius, radius);
-		forwards = std::make_unique<sf::CircleShape>(2.f, 6);
-		forwards->setOrigin(2.f, 2.f);
-		icon = std::make_unique<sf::CircleShape>(3.f, 3);
-		icon->setOrigin(3.f, 3.f);
-		icon->setFillColor(sf::Color(255, 255, 255));
+void applyTreeGravity() {
+	size_t n = bodies.size();
+	double x1 = +INFINITY, y1 = +INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+	for (size_t i = 0; i < n; i++) {
+		if (!bodies.attractor[i] || !bodies.active[i]) {
+			continue;
+		}
+		x1 = std::min(bodies.x[i], x1);
+		y1 = std::min(bodies.y[i], y1);
+		x2 = std::max(bodies.x[i], x2);
+		y2 = std::max(bodies.y[i], y2);
+	}
+	if (x1 > x2) [[unlikely]] {
+		return;
+	}
+	quadtree[0] = Quad();
+	quadtree[0].x = x1;
+	quadtree[0].y = y1;
+	quadtree[0].size = std::max(x2 - x1, y2 - y1);
+	quadsConstructed = 1;
+	for (size_t i = 0; i < n; i++) {
+		if (bodies.attractor[i] && bodies.active[i]) {
+			quadtree[0].put(i);
+		}
 	}
+	for (size_t i = 0; i < n; i++) {
+		if (bodies.active[i] && !bodies.rails[i]) {
+			quadtree[0].pull(i);
+		}
+	}
+}
+
+Triangle::Triangle() : Entity() {
+	mass() = 20000.0;
+	radius() = 16.0;
 }
 
 void Triangle::loadCreatePacket(sf::Packet& packet) {
-	packet << type() << id << x << y << velX << velY << rotation;
+	packet << type() << id << x() << y() << velX() << velY() << rotation;
 	if (debug) {
-		printf("Sent id %d: %g %g %g %g\n", id, x, y, velX, velY);
+		printf("Sent id %d: %g %g %g %g\n", id, x(), y(), velX(), velY());
 	}
 }
 void Triangle::unloadCreatePacket(sf::Packet& packet) {
-	packet >> id >> x >> y >> velX >> velY >> rotation;
+	uint32_t id;
+	packet >> id >> x() >> y() >> velX() >> velY() >> rotation;
+	setID(id);
 	if (debug) {
-		printf("Received id %d: %g %g %g %g\n", id, x, y, velX, velY);
+		printf("Received id %d: %g %g %g %g\n", id, x(), y(), velX(), velY());
 	}
 }
 void Triangle::loadSyncPacket(sf::Packet& packet) {
-	packet << id << x << y << velX << velY << rotation;
+	packet << id << x() << y() << velX() << velY() << rotation;
 }
 void Triangle::unloadSyncPacket(sf::Packet& packet) {
-	packet >> syncX >> syncY >> syncVelX >> syncVelY >> rotation;
+	packet >> syncX() >> syncY() >> syncVelX() >> syncVelY() >> rotation;
 }
 
-void Triangle::simSetup() {
-	Entity::simSetup();
-	resLastBoosted = lastBoosted;
-	resLastShot = lastShot;
-	resHyperboostCharge = hyperboostCharge;
-	resBurning = burning;
-}
-void Triangle::simReset() {
-	Entity::simReset();
-	lastBoosted = resLastBoosted;
-	lastShot = resLastShot;
-	hyperboostCharge = resHyperboostCharge;
-	burning = resBurning;
-}
-
-void Triangle::control(movement& cont) {
-	float rotationRad = rotation * degToRad;
+Triangle::Exhaust Triangle::steer(ShipState& s, movement& cont, double dt, double now) {
+	float rotationRad = s.rotation * degToRad;
 	double xMul = std::cos(rotationRad), yMul = std::sin(rotationRad);
-	if (cont.hyperboost || burning) {
-		hyperboostCharge += delta * (burning ? -2 : 1);
-		hyperboostCharge = std::min(hyperboostCharge, 2.0 * hyperboostTime);
-		burning = hyperboostCharge > hyperboostTime && (burning || (cont.boost && hyperboostCharge > minAfterburn));
-		if (burning) {
-			addVelocity(afterburnStrength * xMul * delta, afterburnStrength * yMul * delta);
-			if (!headless) {
-				forwards->setFillColor(sf::Color(196, 32, 255));
-				forwards->setRotation(90.f - rotation);
-			}
-			return;
+	// same as addVelocity(), y is flipped
+	auto push = [&](double dx, double dy) {
+		s.velX += dx;
+		s.velY -= dy;
+	};
+	if (cont.hyperboost || s.burning) {
+		s.hyperboostCharge += dt * (s.burning ? -2 : 1);
+		s.hyperboostCharge = std::min(s.hyperboostCharge, 2.0 * hyperboostTime);
+		s.burning = s.hyperboostCharge > hyperboostTime && (s.burning || (cont.boost && s.hyperboostCharge > minAfterburn));
+		if (s.burning) {
+			push(afterburnStrength * xMul * dt, afterburnStrength * yMul * dt);
+			return Exhaust::Afterburn;
 		}
 		if (cont.turnleft) {
-			rotateVel += hyperboostRotateSpeed * delta;
+			s.rotateVel += hyperboostRotateSpeed * dt;
 		} else if (cont.turnright) {
-			rotateVel -= hyperboostRotateSpeed * delta;
+			s.rotateVel -= hyperboostRotateSpeed * dt;
 		}
-		if (rotateVel > 0.0) {
-			rotateVel = std::max(0.0, rotateVel - hyperboostRotateSpeed * delta * rotateSlowSpeedMult);
+		if (s.rotateVel > 0.0) {
+			s.rotateVel = std::max(0.0, s.rotateVel - hyperboostRotateSpeed * dt * rotateSlowSpeedMult);
 		}
-		if (rotateVel < 0.0) {
-			rotateVel = std::min(0.0, rotateVel + hyperboostRotateSpeed * delta * rotateSlowSpeedMult);
+		if (s.rotateVel < 0.0) {
+			s.rotateVel = std::min(0.0, s.rotateVel + hyperboostRotateSpeed * dt * rotateSlowSpeedMult);
 		}
-		if (hyperboostCharge > hyperboostTime) {
-			addVelocity(hyperboostStrength * xMul * delta, hyperboostStrength * yMul * delta);
-			if (!headless) {
-				forwards->setFillColor(sf::Color(64, 64, 255));
-				forwards->setRotation(90.f - rotation);
-			}
-		} else if (!headless) {
-			forwards->setFillColor(sf::Color(255, 255, 0));
-			forwards->setRotation(90.f - rotation);
+		if (s.hyperboostCharge > hyperboostTime) {
+			push(hyperboostStrength * xMul * dt, hyperboostStrength * yMul * dt);
+			return Exhaust::Hyperboost;
 		}
-		return;
+		return Exhaust::Charging;
 	} else {
-		hyperboostCharge = 0.0;
+		s.hyperboostCharge = 0.0;
 	}
+	Exhaust exhaust = Exhaust::None;
 	if (cont.forward) {
-		addVelocity(accel * xMul * delta, accel * yMul * delta);
-		if (!headless) {
-			forwards->setFillColor(sf::Color(255, 196, 0));
-			forwards->setRotation(90.f - rotation);
-		}
+		push(accel * xMul * dt, accel * yMul * dt);
+		exhaust = Exhaust::Forward;
 	} else if (cont.backward) {
-		addVelocity(-accel * xMul * delta, -accel * yMul * delta);
-		if (!headless) {
-			forwards->setFillColor(sf::Color(255, 64, 64));
-			forwards->setRotation(270.f - rotation);
-		}
-	} else if (!headless) {
-		forwards->setFillColor(sf::Color::White);
-		forwards->setRotation(90.f - rotation);
+		push(-accel * xMul * dt, -accel * yMul * dt);
+		exhaust = Exhaust::Backward;
 	}
 	if (cont.turnleft) {
-		rotateVel += rotateSpeed * delta;
+		s.rotateVel += rotateSpeed * dt;
 	} else if (cont.turnright) {
-		rotateVel -= rotateSpeed * delta;
+		s.rotateVel -= rotateSpeed * dt;
 	}
-	if (rotateVel > 0.0) {
-		rotateVel = std::max(0.0, rotateVel - rotateSpeed * delta * rotateSlowSpeedMult);
+	if (s.rotateVel > 0.0) {
+		s.rotateVel = std::max(0.0, s.rotateVel - rotateSpeed * dt * rotateSlowSpeedMult);
 	}
-	if (rotateVel < 0.0) {
-		rotateVel = std::min(0.0, rotateVel + rotateSpeed * delta * rotateSlowSpeedMult);
+	if (s.rotateVel < 0.0) {
+		s.rotateVel = std::min(0.0, s.rotateVel + rotateSpeed * dt * rotateSlowSpeedMult);
 	}
-	if (cont.boost && lastBoosted + boostCooldown < globalTime) {
-		addVelocity(boostStrength * xMul, boostStrength * yMul);
-		lastBoosted = globalTime;
-		if (!headless) {
-			forwards->setFillColor(sf::Color(64, 255, 64));
-			forwards->setRotation(90.f - rotation);
-		}
+	if (cont.boost && s.lastBoosted + boostCooldown < now) {
+		push(boostStrength * xMul, boostStrength * yMul);
+		s.lastBoosted = now;
+		exhaust = Exhaust::Boost;
 	}
-	if (cont.primaryfire && lastShot + reload < globalTime) {
-		if (headless || simulating) {
-			Projectile* proj = new Projectile();
-			if (simulating) {
-				simCleanupBuffer.push_back(proj);
-			}
-			proj->setPosition(x + (radius + proj->radius * 2.0) * xMul, y - (radius + proj->radius * 2.0) * yMul);
-			proj->setVelocity(velX + shootPower * xMul, velY - shootPower * yMul);
-			proj->owner = this;
-			addVelocity(-shootPower * xMul * proj->mass / mass, -shootPower * yMul * proj->mass / mass);
-			if (headless) {
-				proj->syncCreation();
-			}
-		}
-		lastShot = globalTime;
+	s.fired = cont.primaryfire && s.lastShot + reload < now;
+	if (s.fired) {
+		s.lastShot = now;
+	}
+	return exhaust;
+}
+
+void Triangle::control(movement& cont) {
+	ShipState s{velX(), velY(), rotation, rotateVel, lastBoosted, lastShot, hyperboostCharge, burning};
+	Exhaust exhaust = steer(s, cont, delta, globalTime);
+	velX() = s.velX;
+	velY() = s.velY;
+	rotateVel = s.rotateVel;
+	lastBoosted = s.lastBoosted;
+	lastShot = s.lastShot;
+	hyperboostCharge = s.hyperboostCharge;
+	burning = s.burning;
+	if (!headless) {
+		static const sf::Color colors[] = {sf::Color::White, sf::Color(255, 196, 0), sf::Color(255, 64, 64), sf::Color(64, 255, 64), sf::Color(64, 64, 255), sf::Color(255, 255, 0), sf::Color(196, 32, 255)};
+		forwardsColor = colors[(size_t)exhaust];
+		forwardsRotation = (exhaust == Exhaust::Backward ? 270.f : 90.f) - rotation;
+	}
+	if (s.fired && headless) {
+		float rotationRad = rotation * degToRad;
+		double xMul = std::cos(rotationRad), yMul = std::sin(rotationRad);
+		Projectile* proj = new Projectile();
+		proj->setPosition(x() + (radius() + proj->radius() * 2.0) * xMul, y() - (radius() + proj->radius() * 2.0) * yMul);
+		proj->setVelocity(velX() + shootPower * xMul, velY() - shootPower * yMul);
+		proj->owner = handle;
+		addVelocity(-shootPower * xMul * proj->mass() / mass(), -shootPower * yMul * proj->mass() / mass());
+		proj->syncCreation();
 	}
 }
 
 void Triangle::draw() {
 	Entity::draw();
-	shape->setPosition(x + drawShiftX, y + drawShiftY);
-	shape->setRotation(90.f - rotation);
-	shape->setFillColor(sf::Color(color[0], color[1], color[2]));
-	window->draw(*shape);
-	g_camera.bindUI();
+	double drawX = x() + drawShiftX, drawY = y() + drawShiftY;
+	// the name sticks out the furthest
+	if (!onScreen(drawX, drawY, radius() + 64.0 * g_camera.scale)) {
+		return;
+	}
+	if (radius() / g_camera.scale >= lodIconRadius) {
+		worldBatch.circle(drawX, drawY, radius(), 3, sf::Color(color[0], color[1], color[2]), 90.f - rotation);
+	}
 	float rotationRad = rotation * degToRad;
-	double uiX = g_camera.w * 0.5 + (x - ownX) / g_camera.scale, uiY = g_camera.h * 0.5 + (y - ownY) / g_camera.scale;
-	forwards->setPosition(uiX + 14.0 * cos(rotationRad), uiY - 14.0 * sin(rotationRad));
+	double uiX = g_camera.w * 0.5 + (x() - ownX) / g_camera.scale, uiY = g_camera.h * 0.5 + (y() - ownY) / g_camera.scale;
 	if (ownEntity == this) {
 		float reloadProgress = ((lastShot - globalTime) / reload + 1.0) * 40.f,
 		boostProgress = ((lastBoosted - globalTime) / boostCooldown + 1.0) * 40.f;
 		if (reloadProgress > 0.0) {
-			sf::RectangleShape reloadBar(sf::Vector2f(reloadProgress, 4.f));
-			reloadBar.setFillColor(sf::Color(255, 64, 64));
-			reloadBar.setPosition(g_camera.w * 0.5f - reloadProgress / 2.f, g_camera.h * 0.5f + 40.f);
-			window->draw(reloadBar);
+			uiBatch.rect(g_camera.w * 0.5f - reloadProgress / 2.f, g_camera.h * 0.5f + 40.f, reloadProgress, 4.f, sf::Color(255, 64, 64));
 		}
 		if (boostProgress > 0.0) {
-			sf::RectangleShape boostReloadBar(sf::Vector2f(boostProgress, 4.f));
-			boostReloadBar.setFillColor(sf::Color(64, 255, 64));
-			boostReloadBar.setPosition(g_camera.w * 0.5f - boostProgress / 2.f, g_camera.h * 0.5f - 40.f);
-			window->draw(boostReloadBar);
+			uiBatch.rect(g_camera.w * 0.5f - boostProgress / 2.f, g_camera.h * 0.5f - 40.f, boostProgress, 4.f, sf::Color(64, 255, 64));
 		}
 		if (hyperboostCharge > 0.0) {
 			float hyperboostProgress = (1.0 - hyperboostCharge / hyperboostTime) * 40.f;
 			if (hyperboostProgress > 0.0) {
-				sf::RectangleShape hyperboostBar(sf::Vector2f(hyperboostProgress, 4.f));
-				hyperboostBar.setFillColor(sf::Color(64, 64, 255));
-				hyperboostBar.setPosition(g_camera.w * 0.5f - hyperboostProgress / 2.f, g_camera.h * 0.5f + 36.f);
-				window->draw(hyperboostBar);
+				uiBatch.rect(g_camera.w * 0.5f - hyperboostProgress / 2.f, g_camera.h * 0.5f + 36.f, hyperboostProgress, 4.f, sf::Color(64, 64, 255));
 			}
 			if (hyperboostProgress < 0.0) {
-				sf::RectangleShape hyperboostBar(sf::Vector2f(-hyperboostProgress, 4.f));
-				hyperboostBar.setFillColor(sf::Color(255, 255, 64));
-				hyperboostBar.setPosition(g_camera.w * 0.5f + hyperboostProgress / 2.f, g_camera.h * 0.5f + 36.f);
-				window->draw(hyperboostBar);
+				uiBatch.rect(g_camera.w * 0.5f + hyperboostProgress / 2.f, g_camera.h * 0.5f + 36.f, -hyperboostProgress, 4.f, sf::Color(255, 255, 64));
 			}
 		}
 	}
-	window->draw(*forwards);
+	uiBatch.circle(uiX + 14.0 * cos(rotationRad), uiY - 14.0 * sin(rotationRad), 2.f, 6, forwardsColor, forwardsRotation);
 	if (!name.empty()) {
-		sf::Text nameText;
-		nameText.setFont(*font);
-		nameText.setString(name);
-		nameText.setCharacterSize(8);
-		nameText.setFillColor(sf::Color::White);
-		nameText.setPosition(uiX - nameText.getLocalBounds().width / 2.0, uiY - 28.0);
-		window->draw(nameText);
+		nameLayout.set(name, 8);
+		labelBatch.add(nameLayout, uiX - nameLayout.width / 2.f, uiY - 28.f, sf::Color::White);
 	}
-	if (g_camera.scale * 2.0 > radius) {
-		icon->setPosition(uiX, uiY);
-		window->draw(*icon);
+	if (g_camera.scale * 2.0 > radius()) {
+		uiBatch.circle(uiX, uiY, 3.f, 3, sf::Color::White);
 	}
-	g_camera.bindWorld();
 }
 
 uint8_t Triangle::type() {
@@ -589,101 +644,74 @@ uint8_t Triangle::type() {
 }
 
 Attractor::Attractor(double radius) : Entity() {
-	this->radius = radius;
-	this->mass = 1.0e18;
-	if (!headless) {
-		shape = std::make_unique<sf::CircleShape>(radius, std::max(4, (int)(sqrt(radius))));
-		shape->setOrigin(radius, radius);
-		icon = std::make_unique<sf::CircleShape>(2.f, 6);
-		icon->setOrigin(2.f, 2.f);
-		warning = std::make_unique<sf::CircleShape>(5.f, 4);
-		warning->setOrigin(5.f, 5.f);
-		warning->setFillColor(sf::Color(0, 0, 0, 0));
-		warning->setOutlineColor(sf::Color(255, 0, 0));
-		warning->setOutlineThickness(1.f);
-	}
+	this->radius() = radius;
+	this->mass() = 1.0e18;
+	bodies.attractor[body] = 1;
 }
 Attractor::Attractor(double radius, double mass) : Entity() {
-	this->radius = radius;
-	this->mass = mass;
-	if (!headless) {
-		shape = std::make_unique<sf::CircleShape>(radius, std::max(4, (int)(sqrt(radius))));
-		shape->setOrigin(radius, radius);
-		icon = std::make_unique<sf::CircleShape>(2.f, 6);
-		icon->setOrigin(2.f, 2.f);
-		warning = std::make_unique<sf::CircleShape>(5.f, 4);
-		warning->setOrigin(5.f, 5.f);
-		warning->setFillColor(sf::Color(0, 0, 0, 0));
-		warning->setOutlineColor(sf::Color(255, 0, 0));
-		warning->setOutlineThickness(1.f);
-	}
+	this->radius() = radius;
+	this->mass() = mass;
+	bodies.attractor[body] = 1;
 }
 Attractor::Attractor(bool ghost) {
-	for (size_t i = 0; i < updateGroup.size(); i++) {
-		Entity* e = updateGroup[i];
-		if (e == this) [[unlikely]] {
-			updateGroup[i] = updateGroup[updateGroup.size() - 1];
-			updateGroup.pop_back();
-			break;
-		}
-	}
+	bodies.active[body] = 0;
+	removeFromGroup(this);
 }
 
 void Attractor::loadCreatePacket(sf::Packet& packet) {
-	packet << type() << radius << id << x << y << velX << velY << mass << star << blackhole << color[0] << color[1] << color[2];
+	packet << type() << radius() << id << x() << y() << velX() << velY() << mass() << star << blackhole << color[0] << color[1] << color[2];
+	bool rails = bodies.rails[body];
+	packet << rails;
+	if (rails) {
+		// the client's clock differs, send where on the orbit it is now instead of the epoch
+		Orbit now = orbit;
+		now.meanAnomaly = remainder(orbit.meanAnomaly + sqrt(orbit.mu / (orbit.a * orbit.a * orbit.a)) * (railTime - orbit.epoch), TAU);
+		packet << railParent << now.mu << now.a << now.e << now.periapsis << now.meanAnomaly << now.turn;
+	}
 	if (debug) {
-		printf("Sent id %d: %g %g %g %g\n", id, x, y, velX, velY);
+		printf("Sent id %d: %g %g %g %g\n", id, x(), y(), velX(), velY());
 	}
 }
 void Attractor::unloadCreatePacket(sf::Packet& packet) {
-	packet >> id >> x >> y >> velX >> velY >> mass >> star >> blackhole >> color[0] >> color[1] >> color[2];
+	uint32_t id;
+	packet >> id >> x() >> y() >> velX() >> velY() >> mass() >> star >> blackhole >> color[0] >> color[1] >> color[2];
+	setID(id);
+	bool rails = false;
+	packet >> rails;
+	if (rails) {
+		packet >> railParent >> orbit.mu >> orbit.a >> orbit.e >> orbit.periapsis >> orbit.meanAnomaly >> orbit.turn;
+		orbit.epoch = railTime;
+		bodies.rails[body] = packet ? 1 : 0;
+	}
 	if (debug) {
-		printf(", id %d: %g %g %g %g\n", id, x, y, velX, velY);
+		printf(", id %d: %g %g %g %g\n", id, x(), y(), velX(), velY());
 	}
 }
 void Attractor::loadSyncPacket(sf::Packet& packet) {
-	packet << id << x << y << velX << velY;
+	packet << id << x() << y() << velX() << velY();
 }
 void Attractor::unloadSyncPacket(sf::Packet& packet) {
-	packet >> syncX >> syncY >> syncVelX >> syncVelY;
+	packet >> syncX() >> syncY() >> syncVelX() >> syncVelY();
 }
 
-void Attractor::update2() {
-	Entity::update2();
-	for (Entity* e : updateGroup) {
-		if (e == this) [[unlikely]] {
-			continue;
-		}
-
-		double xdiff = e->x - x, ydiff = y - e->y;
-		double dist = dst(xdiff, ydiff);
-		double factor = delta * G / (dist * dist * dist);
-		double factorm = -factor * mass;
-		e->addVelocity(xdiff * factorm, ydiff * factorm);
-		if (e->type() != Entities::Attractor) {
-			double factortm = factor * e->mass;
-			addVelocity(xdiff * factortm, ydiff * factortm);
-		}
-	}
-}
 void Attractor::draw() {
 	Entity::draw();
-	shape->setPosition(x + drawShiftX, y + drawShiftY);
-	shape->setFillColor(sf::Color(color[0], color[1], color[2]));
-	window->draw(*shape);
+	double drawX = x() + drawShiftX, drawY = y() + drawShiftY;
+	if (!onScreen(drawX, drawY, radius() + 8.0 * g_camera.scale)) {
+		return;
+	}
+	sf::Color fill(color[0], color[1], color[2]);
+	if (int points = circlePoints(radius(), (int)sqrt(radius()))) {
+		worldBatch.circle(drawX, drawY, radius(), points, fill);
+	}
 	if (ownEntity) {
-		g_camera.bindUI();
-		double uiX = g_camera.w * 0.5 + (x - ownX) / g_camera.scale, uiY = g_camera.h * 0.5 + (y - ownY) / g_camera.scale;
-		if (g_camera.scale > radius) {
-			icon->setPosition(uiX, uiY);
-			icon->setFillColor(sf::Color(color[0], color[1], color[2]));
-			window->draw(*icon);
+		double uiX = g_camera.w * 0.5 + (x() - ownX) / g_camera.scale, uiY = g_camera.h * 0.5 + (y() - ownY) / g_camera.scale;
+		if (g_camera.scale > radius()) {
+			uiBatch.circle(uiX, uiY, 2.f, 6, fill);
 		}
 		if (blackhole && this != lastTrajectoryRef) {
-			warning->setPosition(uiX, uiY);
-			window->draw(*warning);
+			uiBatch.ring(uiX, uiY, 5.f, 4, 1.f, sf::Color(255, 0, 0));
 		}
-		g_camera.bindWorld();
 	}
 }
 
@@ -691,39 +719,56 @@ uint8_t Attractor::type() {
 	return Entities::Attractor;
 }
 
+// buffers of deleted projectiles, new ones take them over instead of growing their own
+static std::vector<std::vector<Handle>> spareNear;
+static std::vector<std::vector<Point>> spareTrajectories;
+
 Projectile::Projectile() : Entity() {
-	this->radius = 6;
-	this->mass = 2000.0;
+	this->radius() = 6;
+	this->mass() = 2000.0;
 	this->color[0] = 180;
 	this->color[1] = 0;
 	this->color[2] = 0;
-	if (!headless && !simulating) {
-		shape = std::make_unique<sf::CircleShape>(radius, 10);
-		shape->setOrigin(radius, radius);
-		icon = std::make_unique<sf::CircleShape>(2.f, 4);
-		icon->setOrigin(2.f, 2.f);
-		icon->setFillColor(sf::Color(255, 0, 0));
-		icon->setRotation(45.f);
+	if (!spareNear.empty()) [[likely]] {
+		near = std::move(spareNear.back());
+		spareNear.pop_back();
+		trajectory = std::move(spareTrajectories.back());
+		spareTrajectories.pop_back();
 	}
 }
+Projectile::~Projectile() noexcept {
+	near.clear();
+	trajectory.clear();
+	spareNear.push_back(std::move(near));
+	spareTrajectories.push_back(std::move(trajectory));
+}
+
+void* Projectile::operator new(size_t) {
+	return projectilePool.acquire();
+}
+void Projectile::operator delete(void* p) {
+	projectilePool.release(p);
+}
 
 void Projectile::loadCreatePacket(sf::Packet& packet) {
-	packet << type() << id << x << y << velX << velY;
+	packet << type() << id << x() << y() << velX() << velY();
 	if (debug) {
-		printf("Sent id %d: %g %g %g %g\n", id, x, y, velX, velY);
+		printf("Sent id %d: %g %g %g %g\n", id, x(), y(), velX(), velY());
 	}
 }
 void Projectile::unloadCreatePacket(sf::Packet& packet) {
-	packet >> id >> x >> y >> velX >> velY;
+	uint32_t id;
+	packet >> id >> x() >> y() >> velX() >> velY();
+	setID(id);
 	if (debug) {
-		printf(", id %d: %g %g %g %g\n", id, x, y, velX, velY);
+		printf(", id %d: %g %g %g %g\n", id, x(), y(), velX(), velY());
 	}
 }
 void Projectile::loadSyncPacket(sf::Packet& packet) {
-	packet << id << x << y << velX << velY;
+	packet << id << x() << y() << velX() << velY();
 }
 void Projectile::unloadSyncPacket(sf::Packet& packet) {
-	packet >> syncX >> syncY >> syncVelX >> syncVelY;
+	packet >> syncX() >> syncY() >> syncVelX() >> syncVelY();
 }
 
 void Projectile::collide(Entity* with, bool collideOther) {
@@ -731,8 +776,8 @@ void Projectile::collide(Entity* with, bool collideOther) {
 		printf("bullet collision: %u-%u ", id, with->id);
 	}
 	if (with->type() == Entities::Triangle) {
-		if (owner) {
-			owner->kills++;
+		if (Triangle* shooter = (Triangle*)registry.get(owner)) {
+			shooter->kills++;
 		}
 		if (debug) {
 			printf("of type triangle\n");
@@ -747,21 +792,18 @@ void Projectile::collide(Entity* with, bool collideOther) {
 					setupShip(p->entity);
 				}
 			}
-			if (owner) {
-				owner->kills++;
+			if (Triangle* shooter = (Triangle*)registry.get(owner)) {
+				shooter->kills++;
 			}
 		}
-		if (headless || simulating) {
+		if (headless) {
 			entityDeleteBuffer.push_back(this);
 		}
-		if (simulating) {
-			entityDeleteBuffer.push_back(with);
-		}
 	} else if (with->type() == Entities::Attractor) {
 		if (debug) {
 			printf("of type attractor\n");
 		}
-		if (headless || simulating) {
+		if (headless) {
 			entityDeleteBuffer.push_back(this);
 		}
 	} else {
@@ -774,14 +816,15 @@ void Projectile::collide(Entity* with, bool collideOther) {
 
 void Projectile::draw() {
 	Entity::draw();
-	shape->setPosition(x + drawShiftX, y + drawShiftY);
-	shape->setFillColor(sf::Color(color[0], color[1], color[2]));
-	window->draw(*shape);
-	if (g_camera.scale > radius) {
-		g_camera.bindUI();
-		icon->setPosition(g_camera.w * 0.5 + (x - ownX) / g_camera.scale, g_camera.h * 0.5 + (y - ownY) / g_camera.scale);
-		window->draw(*icon);
-		g_camera.bindWorld();
+	double drawX = x() + drawShiftX, drawY = y() + drawShiftY;
+	if (!onScreen(drawX, drawY, radius() + 4.0 * g_camera.scale)) {
+		return;
+	}
+	if (int points = circlePoints(radius(), 10)) {
+		worldBatch.circle(drawX, drawY, radius(), points, sf::Color(color[0], color[1], color[2]));
+	}
+	if (g_camera.scale > radius()) {
+		uiBatch.circle(g_camera.w * 0.5 + (x() - ownX) / g_camera.scale, g_camera.h * 0.5 + (y() - ownY) / g_camera.scale, 2.f, 4, sf::Color(255, 0, 0), 45.f);
 	}
 }
 
@@ -0,0 +1,258 @@
+#include "bodies.hpp"
+#include "globals.hpp"
+#include "jobs.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OBF_X86
+#include <immintrin.h>
+#endif
+
+namespace obf {
+
+// gravity sources, G is already multiplied into gm
+struct Sources {
+	std::vector<double> x, y, gm, slot;
+};
+
+// adds the pull of every source on targets [from, to) to accX, accY
+// a target is never pulled by the source in its own slot
+// every kernel does the same operations in the same order without fused multiply-add, keep it that way
+// the Makefile builds with -ffp-contract=off so the compiler doesn't fuse them either, testGravityKernels() checks it
+using Kernel = void (*)(const double* tx, const double* ty, const double* tslot, size_t from, size_t to, const Sources& s, double* accX, double* accY);
+
+static void pullScalar(const double* tx, const double* ty, const double* tslot, size_t from, size_t to, const Sources& s, double* accX, double* accY) {
+	size_t sn = s.slot.size();
+	for (size_t i = from; i < to; i++) {
+		double ax = accX[i], ay = accY[i];
+		for (size_t j = 0; j < sn; j++) {
+			double xdiff = s.x[j] - tx[i], ydiff = s.y[j] - ty[i];
+			double dist = sqrt(xdiff * xdiff + ydiff * ydiff);
+			double factor = s.slot[j] == tslot[i] ? 0.0 : s.gm[j] / (dist * dist * dist);
+			ax += xdiff * factor;
+			ay += ydiff * factor;
+		}
+		accX[i] = ax;
+		accY[i] = ay;
+	}
+}
+
+#ifdef OBF_X86
+__attribute__((target("sse2")))
+static void pullSSE2(const double* tx, const double* ty, const double* tslot, size_t from, size_t to, const Sources& s, double* accX, double* accY) {
+	size_t sn = s.slot.size();
+	size_t i = from;
+	for (; i + 2 <= to; i += 2) {
+		__m128d x = _mm_loadu_pd(tx + i), y = _mm_loadu_pd(ty + i), slot = _mm_loadu_pd(tslot + i);
+		__m128d ax = _mm_loadu_pd(accX + i), ay = _mm_loadu_pd(accY + i);
+		for (size_t j = 0; j < sn; j++) {
+			__m128d xdiff = _mm_sub_pd(_mm_set1_pd(s.x[j]), x), ydiff = _mm_sub_pd(_mm_set1_pd(s.y[j]), y);
+			__m128d dist = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xdiff, xdiff), _mm_mul_pd(ydiff, ydiff)));
+			__m128d factor = _mm_div_pd(_mm_set1_pd(s.gm[j]), _mm_mul_pd(_mm_mul_pd(dist, dist), dist));
+			factor = _mm_andnot_pd(_mm_cmpeq_pd(slot, _mm_set1_pd(s.slot[j])), factor);
+			ax = _mm_add_pd(ax, _mm_mul_pd(xdiff, factor));
+			ay = _mm_add_pd(ay, _mm_mul_pd(ydiff, factor));
+		}
+		_mm_storeu_pd(accX + i, ax);
+		_mm_storeu_pd(accY + i, ay);
+	}
+	pullScalar(tx, ty, tslot, i, to, s, accX, accY);
+}
+
+__attribute__((target("avx2")))
+static void pullAVX2(const double* tx, const double* ty, const double* tslot, size_t from, size_t to, const Sources& s, double* accX, double* accY) {
+	size_t sn = s.slot.size();
+	size_t i = from;
+	for (; i + 4 <= to; i += 4) {
+		__m256d x = _mm256_loadu_pd(tx + i), y = _mm256_loadu_pd(ty + i), slot = _mm256_loadu_pd(tslot + i);
+		__m256d ax = _mm256_loadu_pd(accX + i), ay = _mm256_loadu_pd(accY + i);
+		for (size_t j = 0; j < sn; j++) {
+			__m256d xdiff = _mm256_sub_pd(_mm256_set1_pd(s.x[j]), x), ydiff = _mm256_sub_pd(_mm256_set1_pd(s.y[j]), y);
+			__m256d dist = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(xdiff, xdiff), _mm256_mul_pd(ydiff, ydiff)));
+			__m256d factor = _mm256_div_pd(_mm256_set1_pd(s.gm[j]), _mm256_mul_pd(_mm256_mul_pd(dist, dist), dist));
+			factor = _mm256_andnot_pd(_mm256_cmp_pd(slot, _mm256_set1_pd(s.slot[j]), _CMP_EQ_OQ), factor);
+			ax = _mm256_add_pd(ax, _mm256_mul_pd(xdiff, factor));
+			ay = _mm256_add_pd(ay, _mm256_mul_pd(ydiff, factor));
+		}
+		_mm256_storeu_pd(accX + i, ax);
+		_mm256_storeu_pd(accY + i, ay);
+	}
+	pullScalar(tx, ty, tslot, i, to, s, accX, accY);
+}
+#endif
+
+static Kernel selectKernel() {
+	// per thread, prediction has its own
+	thread_local std::string lastChoice;
+	thread_local Kernel kernel = pullScalar;
+	if (gravityKernel == lastChoice) [[likely]] {
+		return kernel;
+	}
+	lastChoice = gravityKernel;
+	const char* name = "scalar";
+	kernel = pullScalar;
+#ifdef OBF_X86
+	bool any = gravityKernel == "auto";
+	if ((any || gravityKernel == "avx2") && __builtin_cpu_supports("avx2")) {
+		name = "avx2";
+		kernel = pullAVX2;
+	} else if ((any || gravityKernel == "avx2" || gravityKernel == "sse2") && __builtin_cpu_supports("sse2")) {
+		name = "sse2";
+		kernel = pullSSE2;
+	}
+#endif
+	// auto picking something is expected, falling back from what was asked for isn't
+	if (gravityKernel != "auto" && gravityKernel != name) {
+		printf("The %s gravity kernel is unavailable, using %s\n", gravityKernel.c_str(), name);
+	} else if (debug) {
+		printf("Using %s gravity kernel\n", name);
+	}
+	return kernel;
+}
+
+void applyGravity() {
+	WorldState world = bodies.view();
+	applyGravity(world, delta, true);
+}
+
+void applyGravity(WorldState& world, double dt, bool threaded) {
+	thread_local Sources attractors, others, pulled;
+	thread_local std::vector<double> slots, accX, accY, attractorAccX, attractorAccY;
+	Kernel pull = selectKernel();
+	size_t n = world.count;
+	auto run = [threaded](size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+		if (threaded) {
+			parallelFor(n, grain, fn);
+		} else if (n > 0) {
+			fn(0, n);
+		}
+	};
+
+	attractors.x.clear();
+	attractors.y.clear();
+	attractors.gm.clear();
+	attractors.slot.clear();
+	others.x.clear();
+	others.y.clear();
+	others.gm.clear();
+	others.slot.clear();
+	pulled.x.clear();
+	pulled.y.clear();
+	pulled.slot.clear();
+	for (size_t i = 0; i < n; i++) {
+		if (!world.active[i]) [[unlikely]] {
+			continue;
+		}
+		Sources& s = world.attractor[i] ? attractors : others;
+		s.x.push_back(world.x[i]);
+		s.y.push_back(world.y[i]);
+		s.gm.push_back(G * world.mass[i]);
+		s.slot.push_back(i);
+		if (world.attractor[i] && !world.rails[i]) {
+			pulled.x.push_back(world.x[i]);
+			pulled.y.push_back(world.y[i]);
+			pulled.slot.push_back(i);
+		}
+	}
+	if (slots.size() < n) {
+		size_t from = slots.size();
+		slots.resize(n);
+		std::iota(slots.begin() + from, slots.end(), (double)from);
+	}
+	accX.assign(n, 0.0);
+	accY.assign(n, 0.0);
+
+	// the scratch is this thread's, job workers have their own, so they only get pointers to it
+	const double* x = world.x, * y = world.y, * slotData = slots.data();
+	double* ax = accX.data(), * ay = accY.data();
+	const Sources* pulling = &attractors;
+	// attractors pull every body, every target only writes its own accumulator so chunks can run in parallel
+	run(n, 256, [pull, x, y, slotData, ax, ay, pulling](size_t from, size_t to) {
+		pull(x, y, slotData, from, to, *pulling, ax, ay);
+	});
+	// everything else pulls attractors back, except ones on rails, test particles don't pull at all
+	size_t an = world.massless ? 0 : pulled.slot.size();
+	attractorAccX.assign(an, 0.0);
+	attractorAccY.assign(an, 0.0);
+	const double* px = pulled.x.data(), * py = pulled.y.data(), * pslot = pulled.slot.data();
+	double* pax = attractorAccX.data(), * pay = attractorAccY.data();
+	const Sources* pullingBack = &others;
+	run(an, 2, [pull, px, py, pslot, pax, pay, pullingBack](size_t from, size_t to) {
+		pull(px, py, pslot, from, to, *pullingBack, pax, pay);
+	});
+	for (size_t k = 0; k < an; k++) {
+		accX[(size_t)pulled.slot[k]] += attractorAccX[k];
+		accY[(size_t)pulled.slot[k]] += attractorAccY[k];
+	}
+
+	double* velX = world.velX, * velY = world.velY;
+	for (size_t i = 0; i < n; i++) {
+		if (world.active[i] && !world.rails[i]) [[likely]] {
+			velX[i] += accX[i] * dt;
+			velY[i] += accY[i] * dt;
+		}
+	}
+}
+
+bool testGravityKernels(std::string& report) {
+	std::mt19937_64 rng(4127);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	// planets and ships spread over a system, an odd count so the vector kernels' leftovers go through the scalar one
+	const size_t count = 1001, sourceCount = 37;
+	std::vector<double> x(count), y(count), slots(count);
+	for (size_t i = 0; i < count; i++) {
+		double radius = 1.0e3 * pow(1.0e4, unit(rng)), angle = unit(rng) * 2.0 * M_PI;
+		x[i] = radius * cos(angle);
+		y[i] = radius * sin(angle);
+		slots[i] = i;
+	}
+	// sources are some of the targets, those aren't pulled by themselves
+	Sources sources;
+	for (size_t j = 0; j < sourceCount; j++) {
+		size_t i = rng() % count;
+		sources.x.push_back(x[i]);
+		sources.y.push_back(y[i]);
+		sources.gm.push_back(G * 1.0e15 * pow(1.0e6, unit(rng)));
+		sources.slot.push_back(i);
+	}
+	struct Candidate {
+		const char* name;
+		Kernel kernel;
+		bool supported;
+	};
+	std::vector<Candidate> kernels{{"scalar", pullScalar, true}};
+#ifdef OBF_X86
+	kernels.push_back({"sse2", pullSSE2, (bool)__builtin_cpu_supports("sse2")});
+	kernels.push_back({"avx2", pullAVX2, (bool)__builtin_cpu_supports("avx2")});
+#endif
+	std::vector<double> expectX(count, 0.0), expectY(count, 0.0), accX, accY;
+	pullScalar(x.data(), y.data(), slots.data(), 0, count, sources, expectX.data(), expectY.data());
+	bool ok = true;
+	char line[256];
+	for (const Candidate& c : kernels) {
+		if (!c.supported) {
+			snprintf(line, sizeof(line), "%s: not supported by this CPU\n", c.name);
+			report.append(line);
+			continue;
+		}
+		accX.assign(count, 0.0);
+		accY.assign(count, 0.0);
+		c.kernel(x.data(), y.data(), slots.data(), 0, count, sources, accX.data(), accY.data());
+		size_t differ = 0;
+		for (size_t i = 0; i < count; i++) {
+			differ += memcmp(&accX[i], &expectX[i], sizeof(double)) || memcmp(&accY[i], &expectY[i], sizeof(double));
+		}
+		ok &= !differ;
+		snprintf(line, sizeof(line), "%s: %s, %zu of %zu bodies differ from scalar\n", c.name, differ ? "FAILED" : "passed", differ, count);
+		report.append(line);
+	}
+	return ok;
+}
+
+}
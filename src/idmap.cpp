@@ -0,0 +1,77 @@
+#include "idmap.hpp"
+
+namespace obf {
+
+static inline size_t hashID(uint32_t id) {
+	// server IDs are sequential, spread them out
+	return (size_t)(id * 2654435769u);
+}
+
+size_t EntityMap::find(uint32_t id) const {
+	size_t mask = slots.size() - 1;
+	size_t i = hashID(id) & mask;
+	while (slots[i].entity && slots[i].id != id) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+Entity* EntityMap::get(uint32_t id) const {
+	if (count == 0) [[unlikely]] {
+		return nullptr;
+	}
+	return slots[find(id)].entity;
+}
+
+void EntityMap::put(uint32_t id, Entity* e) {
+	if ((count + 1) * 2 > slots.size()) {
+		grow();
+	}
+	Slot& slot = slots[find(id)];
+	if (!slot.entity) {
+		count++;
+	}
+	slot.id = id;
+	slot.entity = e;
+}
+
+void EntityMap::remove(uint32_t id, Entity* e) {
+	if (count == 0) [[unlikely]] {
+		return;
+	}
+	size_t mask = slots.size() - 1;
+	size_t i = find(id);
+	if (slots[i].entity != e) {
+		return;
+	}
+	slots[i].entity = nullptr;
+	count--;
+	// shift later entries of the probe run back so lookups don't stop at the hole
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (!slots[j].entity) {
+			return;
+		}
+		size_t home = hashID(slots[j].id) & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			slots[i] = slots[j];
+			slots[j].entity = nullptr;
+			i = j;
+		}
+	}
+}
+
+void EntityMap::grow() {
+	std::vector<Slot> old;
+	old.swap(slots);
+	slots.resize(old.empty() ? 64 : old.size() * 2);
+	count = 0;
+	for (Slot& slot : old) {
+		if (slot.entity) {
+			put(slot.id, slot.entity);
+		}
+	}
+}
+
+}
@@ -0,0 +1,168 @@
+#include "entities.hpp"
+#include "globals.hpp"
+#include "idmap.hpp"
+#include "interest.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace obf {
+
+struct Cell {
+	uint32_t start, count;
+};
+
+// (cell key, entity) sorted by key, cells index into it
+static std::vector<std::pair<uint64_t, Entity*>> entries;
+static std::unordered_map<uint64_t, Cell> cells;
+static double cellSize = 1.0;
+
+static inline int64_t cellOf(double v) {
+	return (int64_t)std::floor(v / cellSize);
+}
+static inline uint64_t cellKey(int64_t cx, int64_t cy) {
+	return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+// half the size of the box around a player's ship it gets synced, the same one the per entity cull test used
+static inline void areaOf(Player* player, double& halfW, double& halfH) {
+	halfW = player->viewW * syncCullThreshold + syncCullOffset;
+	halfH = player->viewH * syncCullThreshold + syncCullOffset;
+}
+
+// how much a stale state hurts, planets knocked off their orbit pull on everything around them and ships get shot at
+static inline float importance(Entity* e) {
+	switch (e->type()) {
+	case Entities::Attractor:
+		return 4.f;
+	case Entities::Triangle:
+		return 2.f;
+	default:
+		return 1.f;
+	}
+}
+
+void indexInterest(const std::vector<Player*>& players) {
+	cellSize = 1.0;
+	for (Player* player : players) {
+		double halfW, halfH;
+		areaOf(player, halfW, halfH);
+		cellSize = std::max({cellSize, halfW * 2.0, halfH * 2.0});
+	}
+	entries.clear();
+	for (Entity* e : updateGroup) {
+		// clients move these themselves
+		if (bodies.rails[e->body]) {
+			continue;
+		}
+		entries.push_back({cellKey(cellOf(e->x()), cellOf(e->y())), e});
+	}
+	std::sort(entries.begin(), entries.end(), [](const std::pair<uint64_t, Entity*>& a, const std::pair<uint64_t, Entity*>& b) {
+		return a.first < b.first;
+	});
+	cells.clear();
+	for (uint32_t k = 0; k < entries.size(); k++) {
+		if (k == 0 || entries[k].first != entries[k - 1].first) {
+			cells[entries[k].first] = {k, 0};
+		}
+		cells[entries[k].first].count++;
+	}
+}
+
+void selectInterest(Player* player, std::vector<Entity*>& visible, std::vector<Entity*>& leaving) {
+	// reused between syncs, known gets swapped with the player's
+	static thread_local std::vector<Entity*> area;
+	static thread_local std::vector<Interest> known;
+	static thread_local std::vector<std::pair<float, uint32_t>> ranked;
+	area.clear();
+	known.clear();
+	ranked.clear();
+
+	Entity* own = player->entity;
+	double x = 0.0, y = 0.0;
+	if (own) {
+		x = own->x();
+		y = own->y();
+		double halfW, halfH;
+		areaOf(player, halfW, halfH);
+		int64_t cx1 = cellOf(x - halfW), cy1 = cellOf(y - halfH), cx2 = cellOf(x + halfW), cy2 = cellOf(y + halfH);
+		for (int64_t cx = cx1; cx <= cx2; cx++) {
+			for (int64_t cy = cy1; cy <= cy2; cy++) {
+				auto it = cells.find(cellKey(cx, cy));
+				if (it == cells.end()) {
+					continue;
+				}
+				Cell cell = it->second;
+				for (uint32_t k = cell.start; k < cell.start + cell.count; k++) {
+					Entity* e = entries[k].second;
+					if (std::abs(e->x() - x) <= halfW && std::abs(e->y() - y) <= halfH) {
+						area.push_back(e);
+					}
+				}
+			}
+		}
+	} else {
+		// nothing to center it on, everything is near
+		for (const std::pair<uint64_t, Entity*>& entry : entries) {
+			area.push_back(entry.second);
+		}
+	}
+	std::sort(area.begin(), area.end(), [](Entity* a, Entity* b) {
+		return a->id < b->id;
+	});
+
+	// walk it alongside what the player knew, both sorted by id, known lines up with area
+	double viewW = std::max(player->viewW, 1.0), viewH = std::max(player->viewH, 1.0);
+	size_t k = 0;
+	for (uint32_t i = 0; i < area.size(); i++) {
+		Entity* e = area[i];
+		for (; k < player->known.size() && player->known[k].id < e->id; k++) {
+			// deleted ones were already despawned for everyone
+			if (Entity* gone = entityMap.get(player->known[k].id)) {
+				leaving.push_back(gone);
+			}
+		}
+		bool entered = k == player->known.size() || player->known[k].id != e->id;
+		// it's out of date on the client or never was synced, and the own ship is always sent
+		if (entered || e == own) {
+			visible.push_back(e);
+			known.push_back({e->id, 0.f});
+			k += !entered;
+			continue;
+		}
+		float priority = player->known[k++].priority;
+		// things further than a view away matter less the further they are
+		double views = own ? std::max({std::abs(e->x() - x) / viewW, std::abs(e->y() - y) / viewH, 1.0}) : 1.0;
+		priority += importance(e) / (float)views;
+		known.push_back({e->id, priority});
+		ranked.push_back({priority, i});
+	}
+	for (; k < player->known.size(); k++) {
+		if (Entity* gone = entityMap.get(player->known[k].id)) {
+			leaving.push_back(gone);
+		}
+	}
+
+	size_t most = ranked.size();
+	if (syncBandwidth > 0.0) {
+		// up to a second of bandwidth saved up, what has to go anyway is paid for first
+		double states = syncBandwidth * std::min(globalTime - player->lastSynced, 1.0) / std::max(player->stateCost, 1.0) - visible.size();
+		most = std::min(most, (size_t)std::max(states, 0.0));
+	}
+	if (most < ranked.size()) {
+		std::nth_element(ranked.begin(), ranked.begin() + most, ranked.end(), std::greater<std::pair<float, uint32_t>>());
+	}
+	for (size_t j = 0; j < most; j++) {
+		uint32_t i = ranked[j].second;
+		visible.push_back(area[i]);
+		known[i].priority = 0.f;
+	}
+	std::swap(known, player->known);
+}
+
+}
@@ -0,0 +1,137 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace obf {
+
+struct Job {
+	const std::function<void(size_t, size_t)>* fn;
+	size_t from, to;
+	std::atomic<size_t>* remaining;
+};
+
+struct JobQueue {
+	std::mutex lock;
+	std::deque<Job> jobs;
+};
+
+// queue 0 belongs to the main thread
+static std::vector<std::unique_ptr<JobQueue>> queues;
+static std::vector<std::thread> workers;
+static std::mutex sleepLock;
+static std::condition_variable wake;
+static std::atomic<size_t> queued{0};
+static bool stopping = false;
+
+// the owner takes from the back, thieves from the front
+static bool takeJob(size_t self, Job& job) {
+	{
+		JobQueue& own = *queues[self];
+		std::lock_guard guard(own.lock);
+		if (!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	for (size_t i = 1; i < queues.size(); i++) {
+		JobQueue& other = *queues[(self + i) % queues.size()];
+		std::lock_guard guard(other.lock);
+		if (!other.jobs.empty()) {
+			job = other.jobs.front();
+			other.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+static void runJob(Job& job) {
+	queued--;
+	(*job.fn)(job.from, job.to);
+	job.remaining->fetch_sub(1, std::memory_order_release);
+}
+
+static void workerLoop(size_t self) {
+	while (true) {
+		Job job;
+		if (takeJob(self, job)) {
+			runJob(job);
+			continue;
+		}
+		std::unique_lock guard(sleepLock);
+		wake.wait(guard, [] { return stopping || queued > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+void startJobs(int threads) {
+	if (threads <= 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	queues.push_back(std::make_unique<JobQueue>());
+	for (int i = 1; i < threads; i++) {
+		queues.push_back(std::make_unique<JobQueue>());
+	}
+	for (int i = 1; i < threads; i++) {
+		workers.emplace_back(workerLoop, i);
+	}
+}
+
+void stopJobs() {
+	{
+		std::lock_guard guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+	workers.clear();
+	queues.clear();
+}
+
+void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+	grain = std::max(grain, (size_t)1);
+	if (workers.empty() || n <= grain) {
+		if (n > 0) {
+			fn(0, n);
+		}
+		return;
+	}
+	// a few chunks per thread so stealing can even out uneven ones
+	size_t chunks = std::min((n + grain - 1) / grain, queues.size() * 4);
+	size_t chunkSize = (n + chunks - 1) / chunks;
+	chunks = (n + chunkSize - 1) / chunkSize;
+	std::atomic<size_t> remaining{chunks};
+	// counted before any can be taken so a worker that's already awake can't take it below zero
+	{
+		std::lock_guard guard(sleepLock);
+		queued += chunks;
+	}
+	for (size_t i = 0; i < chunks; i++) {
+		JobQueue& queue = *queues[i % queues.size()];
+		std::lock_guard guard(queue.lock);
+		queue.jobs.push_back({&fn, i * chunkSize, std::min(n, (i + 1) * chunkSize), &remaining});
+	}
+	wake.notify_all();
+	while (remaining.load(std::memory_order_acquire) > 0) {
+		Job job;
+		if (takeJob(0, job)) {
+			runJob(job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+}
@@ -0,0 +1,59 @@
+#include "kepler.hpp"
+#include "math.hpp"
+
+#include <cmath>
+
+namespace obf {
+
+bool fitOrbit(Orbit& orbit, double x, double y, double velX, double velY, double mu, double time) {
+	double r = sqrt(x * x + y * y), v2 = velX * velX + velY * velY;
+	double energy = 0.5 * v2 - mu / r;
+	double h = x * velY - y * velX;
+	if (r == 0.0 || mu <= 0.0 || energy >= 0.0 || h == 0.0) {
+		return false;
+	}
+	orbit.mu = mu;
+	orbit.a = -mu / (2.0 * energy);
+	orbit.turn = h < 0.0 ? -1.0 : 1.0;
+	// eccentricity vector points at periapsis
+	double rv = x * velX + y * velY;
+	double ex = ((v2 - mu / r) * x - rv * velX) / mu, ey = ((v2 - mu / r) * y - rv * velY) / mu;
+	orbit.e = sqrt(ex * ex + ey * ey);
+	if (orbit.e >= 1.0) {
+		return false;
+	}
+	// circles have no periapsis, measure from the x axis
+	orbit.periapsis = orbit.e > 1.0e-12 ? atan2(ey, ex) : 0.0;
+	double trueAnomaly = orbit.turn * (atan2(y, x) - orbit.periapsis);
+	double E = 2.0 * atan2(sqrt(1.0 - orbit.e) * sin(trueAnomaly * 0.5), sqrt(1.0 + orbit.e) * cos(trueAnomaly * 0.5));
+	orbit.meanAnomaly = E - orbit.e * sin(E);
+	orbit.epoch = time;
+	return true;
+}
+
+void orbitState(const Orbit& orbit, double time, double& x, double& y, double& velX, double& velY) {
+	double n = sqrt(orbit.mu / (orbit.a * orbit.a * orbit.a)), e = orbit.e;
+	// keep the anomaly small so long running servers don't lose precision
+	double M = remainder(orbit.meanAnomaly + n * (time - orbit.epoch), TAU);
+	// Newton's method on Kepler's equation, starting from pi keeps it converging for eccentric orbits
+	double E = e < 0.8 ? M : PI * (M < 0.0 ? -1.0 : 1.0);
+	for (int i = 0; i < 32; i++) {
+		double step = (E - e * sin(E) - M) / (1.0 - e * cos(E));
+		E -= step;
+		if (fabs(step) < 1.0e-14) {
+			break;
+		}
+	}
+	double cosE = cos(E), sinE = sin(E), b = sqrt(1.0 - e * e);
+	// in the orbit's own frame, periapsis along x
+	double px = orbit.a * (cosE - e), py = orbit.a * b * sinE * orbit.turn;
+	double speed = n * orbit.a / (1.0 - e * cosE);
+	double pvx = -sinE * speed, pvy = b * cosE * speed * orbit.turn;
+	double c = cos(orbit.periapsis), s = sin(orbit.periapsis);
+	x = c * px - s * py;
+	y = s * px + c * py;
+	velX = c * pvx - s * pvy;
+	velY = s * pvx + c * pvy;
+}
+
+}
@@ -0,0 +1,222 @@
+#include "globals.hpp"
+#include "loadtest.hpp"
+#include "strings.hpp"
+#include "types.hpp"
+
+#include <SFML/Network.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace obf {
+
+// packets of each kind a fake client sends per millisecond
+constexpr int loadBurst = 4;
+
+enum LoadPhase {
+	Idle,
+	Connecting,
+	Threaded,
+	Inline
+};
+
+// ticks measured in a phase, pieced together from the per second stats ticktime prints
+struct LoadStats {
+	double ticks = 0.0, work = 0.0, work2 = 0.0, worst = 0.0;
+};
+
+static std::vector<std::thread> clients;
+static std::atomic<bool> loadRunning = false;
+static std::atomic<size_t> loadSent = 0, loadConnected = 0;
+static LoadPhase phase = Idle;
+static double phaseStart = 0.0, phaseLength = 0.0, lastSample = 0.0, took[2];
+static bool wasThreaded = true;
+static LoadStats stats[2];
+static size_t sentBefore = 0, sent[2];
+
+// false once the connection is gone or the test is over, a full socket buffer just drops the packet
+static bool sendTcp(sf::TcpSocket& tcp, sf::Packet& packet) {
+	sf::Socket::Status status;
+	// the rest of a partly sent packet has to follow or the stream falls apart
+	while ((status = tcp.send(packet)) == sf::Socket::Partial) {
+		if (!loadRunning.load(std::memory_order_relaxed)) {
+			return false;
+		}
+		std::this_thread::yield();
+	}
+	return status == sf::Socket::Done || status == sf::Socket::NotReady;
+}
+
+static void fakeClient(int index) {
+	sf::TcpSocket tcp;
+	if (tcp.connect(sf::IpAddress::LocalHost, port, sf::seconds(5.f)) != sf::Socket::Done) {
+		return;
+	}
+	loadConnected++;
+	sf::UdpSocket udp;
+	bool hasUdp = udp.bind(sf::Socket::AnyPort) == sf::Socket::Done;
+	sf::SocketSelector selector;
+	selector.add(tcp);
+	if (hasUdp) {
+		selector.add(udp);
+	}
+	sf::Packet nickname;
+	nickname << Packets::Nickname << "load" + std::to_string(index);
+	tcp.send(nickname);
+	// never blocks, so the server can stop reading (and join this thread) whenever
+	tcp.setBlocking(false);
+	udp.setBlocking(false);
+
+	uint32_t token = 0, lastTick = 0;
+	double lastHello = -1.0;
+	sf::Clock clock;
+	unsigned char turning = 0;
+	while (loadRunning.load(std::memory_order_relaxed)) {
+		// take everything the server sent so its buffers don't fill up and drop us
+		while (selector.wait(sf::microseconds(1))) {
+			if (selector.isReady(tcp)) {
+				sf::Packet packet;
+				sf::Socket::Status status = tcp.receive(packet);
+				if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+					return;
+				}
+				uint16_t type;
+				if (status == sf::Socket::Done && packet >> type && type == Packets::UdpToken) {
+					packet >> token;
+				}
+			}
+			if (hasUdp && selector.isReady(udp)) {
+				sf::Packet packet;
+				sf::IpAddress address;
+				unsigned short from;
+				uint32_t sequence;
+				uint16_t type;
+				if (udp.receive(packet, address, from) == sf::Socket::Done && packet >> sequence >> type && type == Packets::DeltaSnapshot) {
+					packet >> lastTick;
+				}
+			}
+		}
+		double now = clock.getElapsedTime().asSeconds();
+		if (hasUdp && token && now - lastHello > 1.0) {
+			sf::Packet hello;
+			hello << token << Packets::UdpHello;
+			udp.send(hello, sf::IpAddress::LocalHost, port);
+			lastHello = now;
+		}
+		for (int i = 0; i < loadBurst; i++) {
+			// only turning, so the load stays on the network instead of projectiles
+			turning ^= 4;
+			sf::Packet controls;
+			controls << Packets::Controls << turning;
+			if (!sendTcp(tcp, controls)) {
+				return;
+			}
+			loadSent++;
+			if (hasUdp && token) {
+				sf::Packet ack;
+				ack << token << Packets::SnapshotAck << lastTick << true;
+				udp.send(ack, sf::IpAddress::LocalHost, port);
+				loadSent++;
+			}
+		}
+		sf::sleep(sf::milliseconds(1));
+	}
+}
+
+static void stopClients() {
+	loadRunning = false;
+	for (std::thread& t : clients) {
+		t.join();
+	}
+	clients.clear();
+}
+
+static void beginPhase(LoadPhase next) {
+	phase = next;
+	phaseStart = globalTime;
+	sentBefore = loadSent;
+}
+
+static void printStats(const char* name, const LoadStats& s, size_t packets, double seconds) {
+	double mean = s.ticks ? s.work / s.ticks : 0.0;
+	double jitter = s.ticks ? sqrt(std::max(s.work2 / s.ticks - mean * mean, 0.0)) : 0.0;
+	char line[192];
+	snprintf(line, sizeof(line), "%s: mean %.3fms, jitter %.3fms, worst %.3fms over %.0f ticks, %.0f packets/s coming in\n",
+		name, mean * 1000.0, jitter * 1000.0, s.worst * 1000.0, s.ticks, packets / seconds);
+	printPreferred(line);
+}
+
+void startLoadTest(int clientCount, double seconds) {
+	if (phase != Idle) {
+		printPreferred("A load test is already running.\n");
+		return;
+	}
+	wasThreaded = threadedNet;
+	phaseLength = std::max(seconds, 1.0);
+	stats[0] = stats[1] = LoadStats();
+	loadSent = 0;
+	loadConnected = 0;
+	loadRunning = true;
+	for (int i = 0; i < clientCount; i++) {
+		clients.emplace_back(fakeClient, i);
+	}
+	beginPhase(Connecting);
+	lastSample = lastShowFramerate;
+}
+
+void updateLoadTest() {
+	if (phase == Idle) [[likely]] {
+		return;
+	}
+	// a new second of stats came out, only count it if all of it was in this phase
+	if (lastShowFramerate != lastSample) {
+		lastSample = lastShowFramerate;
+		if ((phase == Threaded || phase == Inline) && lastShowFramerate - 1.0 >= phaseStart) {
+			LoadStats& s = stats[phase == Inline];
+			double n = framerate;
+			s.ticks += n;
+			s.work += tickTime * n;
+			s.work2 += (tickJitter * tickJitter + tickTime * tickTime) * n;
+			s.worst = std::max(s.worst, worstTick);
+		}
+	}
+	switch (phase) {
+	case Connecting:
+		if (globalTime - phaseStart > 2.0) {
+			char line[96];
+			snprintf(line, sizeof(line), "%zu of %zu fake clients connected, measuring for %gs each way\n", (size_t)loadConnected, clients.size(), phaseLength);
+			printPreferred(line);
+			threadedNet = true;
+			beginPhase(Threaded);
+		}
+		break;
+	case Threaded:
+		if (globalTime - phaseStart > phaseLength + 1.0) {
+			sent[0] = loadSent - sentBefore;
+			took[0] = globalTime - phaseStart;
+			threadedNet = false;
+			beginPhase(Inline);
+		}
+		break;
+	case Inline:
+		if (globalTime - phaseStart > phaseLength + 1.0) {
+			sent[1] = loadSent - sentBefore;
+			took[1] = globalTime - phaseStart;
+			threadedNet = wasThreaded;
+			stopClients();
+			phase = Idle;
+			printStats("network thread", stats[0], sent[0], took[0]);
+			printStats("in the tick", stats[1], sent[1], took[1]);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+}
@@ -1,15 +1,23 @@
+#include "broadphase.hpp"
 #include "camera.hpp"
 #include "entities.hpp"
 #include "font.hpp"
 #include "globals.hpp"
+#include "interest.hpp"
+#include "jobs.hpp"
+#include "loadtest.hpp"
 #include "math.hpp"
 #include "net.hpp"
+#include "netio.hpp"
+#include "predict.hpp"
+#include "render.hpp"
 #include "types.hpp"
 #include "strings.hpp"
 
 #include <SFML/Graphics.hpp>
 #include <SFML/Network.hpp>
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <cstring>
@@ -45,6 +53,7 @@ void connectToServer() {
 			printf("Could not connect to %s:%u.\n", address.c_str(), port);
 		} else {
 			printf("Connected to %s:%u.\n", address.c_str(), port);
+			resetSync();
 			sf::Packet nicknamePacket;
 			nicknamePacket << Packets::Nickname << name;
 			serverSocket->send(nicknamePacket);
@@ -53,6 +62,121 @@ void connectToServer() {
 	}
 }
 
+void joinPlayer(Player* player) {
+	printf("%s has connected.\n", player->name().c_str());
+	player->lastAck = globalTime;
+	playerGroup.push_back(player);
+	for (Entity* e : updateGroup) {
+		sf::Packet packet;
+		packet << Packets::CreateEntity;
+		e->loadCreatePacket(packet);
+		player->send(packet);
+	}
+
+	player->entity = new Triangle();
+	setupShip(player->entity);
+	player->entity->player = player;
+	player->entity->syncCreation();
+	sf::Packet entityAssign;
+	entityAssign << Packets::AssignEntity << player->entity->id;
+	player->send(entityAssign);
+	for (Player* p: playerGroup) {
+		sf::Packet namePacket;
+		namePacket << Packets::Name << p->entity->id << p->username;
+		player->send(namePacket);
+	}
+	if (udpSocket) {
+		player->udpToken = newUdpToken();
+		sf::Packet tokenPacket;
+		tokenPacket << Packets::UdpToken << player->udpToken;
+		player->send(tokenPacket);
+	}
+}
+
+// one tick of physics, delta long
+void simulateStep() {
+	if (headless) {
+		for (Player* player : playerGroup) {
+			if (player->entity && !player->disconnected) {
+				player->entity->control(player->controls);
+			}
+		}
+	} else {
+		if (ownEntity) {
+			if (lockControls) {
+				unsigned char zero = 0;
+				ownEntity->control(*(movement*)&zero);
+			} else {
+				ownEntity->control(controls);
+			}
+		}
+		bodies.saveLast();
+	}
+	advance();
+	for (Entity* e : updateGroup) {
+		e->update1();
+	}
+	scanCollisions();
+	for (Entity* e : updateGroup) {
+		e->update2();
+	}
+
+	if (headless && lastSweep + projectileSweepSpacing < globalTime) {
+		for (Entity* e : updateGroup) {
+			if (e->type() != Entities::Projectile) {
+				continue;
+			}
+			double closest = DBL_MAX;
+			for (Player* p : playerGroup) {
+				if (!p->entity) {
+					continue;
+				}
+				closest = std::min(closest, dst2(e->x() - p->entity->x(), e->y() - p->entity->y()));
+			}
+			if (closest > sweepThreshold) {
+				entityDeleteBuffer.push_back(e);
+			}
+		}
+		lastSweep = globalTime;
+	}
+	// the same entity can get queued more than once, e.g. a projectile hitting two things in one tick
+	std::sort(entityDeleteBuffer.begin(), entityDeleteBuffer.end());
+	entityDeleteBuffer.erase(std::unique(entityDeleteBuffer.begin(), entityDeleteBuffer.end()), entityDeleteBuffer.end());
+	for (Entity* e : entityDeleteBuffer) {
+		delete e;
+	}
+	entityDeleteBuffer.clear();
+	tickCount++;
+}
+
+// with fixedStep as many steps as the time since the last ones makes up for, each at its own globalTime
+void stepWorld() {
+	if (skipStep) {
+		skipStep = false;
+		stepAccumulator = 0.0;
+		return;
+	}
+	if (!fixedStep) {
+		simulateStep();
+		return;
+	}
+	double step = 1.0 / tickRate, now = globalTime;
+	int steps = 0;
+	globalTime = now - stepAccumulator;
+	while (stepAccumulator >= step && steps < maxSubsteps) {
+		delta = 60.0 / tickRate;
+		globalTime += step;
+		simulateStep();
+		stepAccumulator -= step;
+		steps++;
+	}
+	// too far behind to catch up, let the backlog go instead of spending even longer on it next frame
+	if (steps == maxSubsteps) {
+		stepAccumulator = std::min(stepAccumulator, step);
+	}
+	globalTime = now;
+}
+
 void inputListen() {
 	do {
 		std::string buffer;
@@ -76,11 +200,36 @@ int main(int argc, char** argv) {
 		out << "port: Used both as the port to host on and to specify port for autoConnect if server address does not contain port (short uint)" << std::endl;
 		out << "predictDelta: As a client, how many ticks to advance every prediction simulation step (double)" << std::endl;
 		out << "predictSpacing: As a client, how many seconds to wait between trajectory prediction simulations (double)" << std::endl;
+		out << "predictTolerance: As a client, how far things can stray from the last prediction before it's redone from scratch instead of extended (double)" << std::endl;
+		out << "predictAdaptive: As a client, whether prediction steps get shorter near attractors and longer far from them instead of always being [predictDelta] ticks, still covering [predictSteps] * [predictDelta] ticks (bool)" << std::endl;
+		out << "predictAccuracy: With predictAdaptive, what fraction of the shortest free-fall time to an attractor a step is, lower is more accurate (double)" << std::endl;
+		out << "predictMinDelta: With predictAdaptive, the fewest ticks a prediction step can be (double)" << std::endl;
+		out << "predictMaxDelta: With predictAdaptive, the most ticks a prediction step can be (double)" << std::endl;
+		out << "lodIconRadius: As a client, how many pixels a body's radius has to be on screen for its shape to be drawn, smaller ones only get their icon (double)" << std::endl;
+		out << "predictMassless: As a client, whether to predict only attractors and your own ship, as a particle that doesn't pull back, much cheaper so predictSteps can go up about 10x (bool)" << std::endl;
 		out << "NOTE: any clients will have to have the same physics-related configs as the server for them to work properly" << std::endl;
 		out << "friction: Friction of touching bodies (double)" << std::endl;
 		out << "collideRestitution: How bouncy collisions are (double)" << std::endl;
 		out << "gravityStrength: How strong gravity is (double)" << std::endl;
+		out << "fixedStep: Whether to simulate in fixed steps of 1 / tickRate seconds instead of however long the last frame took, keeps clients and the server in agreement (bool)" << std::endl;
+		out << "tickRate: With fixedStep, how many steps to simulate per second, the server ticks at this rate regardless of targetFramerate (double)" << std::endl;
+		out << "maxSubsteps: With fixedStep, the most steps to simulate in one frame to catch up after a slow one, time beyond that is skipped (int)" << std::endl;
+		out << "barnesHut: Whether to approximate gravity using the quadtree instead of computing it exactly, faster with many attractors (bool)" << std::endl;
+		out << "onRails: As a server, whether generated planets and moons follow fixed Kepler orbits instead of being simulated until something hits them, they aren't synced while on rails (bool)" << std::endl;
+		out << "barnesHutTheta: With barnesHut, how small a quadtree node has to look (size / distance) to be treated as one body, lower is more accurate (double)" << std::endl;
+		out << "gravityKernel: Which vectorized gravity kernel to use if the CPU supports it: auto, avx2, sse2 or scalar, all give identical results (string)" << std::endl;
+		out << "integrator: How to step positions and gravity: euler (1st order), leapfrog (2nd order) or yoshida (4th order, 3x the gravity cost), all keep orbits from drifting away (string)" << std::endl;
+		out << "threads: How many threads to run physics and syncing on, 0 to use every core (int)" << std::endl;
 		out << "syncSpacing: As a server, how often should clients be synced (double)" << std::endl;
+		out << "sendBufferSize: As a server, how many bytes can wait to be sent to a player before they're dropped for being too slow, syncing slows down once a quarter of it is used (int)" << std::endl;
+		out << "batchSync: As a server, whether to sync all entities in one snapshot packet instead of one packet each, turn off for old clients (bool)" << std::endl;
+		out << "deltaSync: As a server, whether to compress snapshots by sending only what changed since the last one the client received, needs batchSync (bool)" << std::endl;
+		out << "udpSync: As a server, whether to send snapshots over udp to clients that support it so a lost packet doesn't delay the ones after it (bool)" << std::endl;
+		out << "udpLoss: As a server, what fraction of udp snapshots to drop on purpose, for testing how clients cope with a lossy connection (double)" << std::endl;
+		out << "syncPrecision: As a server with deltaSync, what fraction of a player's view to sync positions of on-screen entities to, off-screen ones get less precise the further they are (double)" << std::endl;
+		out << "threadedNet: As a server, whether sockets are read and written on their own thread instead of in the tick, off is only for comparing how much that costs the tick (bool)" << std::endl;
+		out << "interestSync: As a server, whether to sync each player only what's near them, ranked by distance and importance within syncBandwidth, instead of everything in view plus all of it every fullSyncSpacing (bool)" << std::endl;
+		out << "syncBandwidth: As a server with interestSync, how many bytes of snapshots per second each player gets at most, 0 for no limit (double)" << std::endl;
 		out << "gen_blackholeChance: As a server, what fraction of stars should instead be black holes (double)" << std::endl;
 		out << "gen_extraStarChance: As a server, the chance for an additional star to generate after the previous (double)" << std::endl;
 		out << "autorestartSpacing: As a server, if autorestart is enabled, how many seconds to wait between autorestarts (double)" << std::endl;
@@ -118,6 +267,16 @@ int main(int argc, char** argv) {
 		}
 
 		printf("Hosted server on port %u.\n", port);
+		udpSocket = new sf::UdpSocket;
+		udpSocket->setBlocking(false);
+		if (udpSocket->bind(port) != sf::Socket::Done) {
+			printf("Could not bind udp port %u, syncing over tcp only.\n", port);
+			delete udpSocket;
+			udpSocket = nullptr;
+		}
+		if (threadedNet) {
+			startNetThread();
+		}
 
 		generateSystem();
 	} else {
@@ -132,15 +291,10 @@ int main(int argc, char** argv) {
 			return 1;
 		}
 
-		posInfo = new sf::Text;
-		chat = new sf::Text;
-		posInfo->setFont(*font);
-		posInfo->setCharacterSize(textCharacterSize);
-		posInfo->setFillColor(sf::Color::White);
-		chat->setFont(*font);
-		chat->setCharacterSize(textCharacterSize);
-		chat->setFillColor(sf::Color::White);
+		prepareGlyphs(8);
+		prepareGlyphs(textCharacterSize);
 
+		nextID = localIDStart;
 		systemCenter = new Attractor(true);
 
 		if (autoConnect && !serverAddress.empty()) {
@@ -171,6 +325,8 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	startJobs(threads);
+
 	while (headless || window->isOpen()) {
 		if (headless) {
 			if(!inputWaiting){
@@ -183,7 +339,7 @@ int main(int argc, char** argv) {
 			}
 			if (autorestart) {
 				if (playerGroup.size() == 0) {
-					delta = 0.0;
+					skipStep = true;
 					lastAutorestartNotif = -autorestartNotifSpacing;
 					lastAutorestart = globalTime;
 					if (!autorestartRegenned) {
@@ -201,8 +357,10 @@ int main(int argc, char** argv) {
 					autorestartRegenned = true;
 				} else {
 					if (lastAutorestart + autorestartSpacing < globalTime) {
-						delta = 0.0;
-						for (Entity* e :updateGroup) {
+						skipStep = true;
+						// deleting takes entities out of updateGroup, so go over a copy
+						std::vector<Entity*> oldGroup(updateGroup);
+						for (Entity* e : oldGroup) {
 							if (e->type() != Entities::Triangle) {
 								delete e;
 							}
@@ -229,36 +387,45 @@ int main(int argc, char** argv) {
 					autorestartRegenned = false;
 				}
 			}
-			sf::Socket::Status status = connectListener->accept(sparePlayer->tcpSocket);
-			if (status == sf::Socket::Done) {
-				sparePlayer->ip = sparePlayer->tcpSocket.getRemoteAddress().toString();
-				sparePlayer->port = sparePlayer->tcpSocket.getRemotePort();
-				printf("%s has connected.\n", sparePlayer->name().c_str());
-				sparePlayer->lastAck = globalTime;
-				playerGroup.push_back(sparePlayer);
-				for (Entity* e : updateGroup) {
-					sf::Packet packet;
-					packet << Packets::CreateEntity;
-					e->loadCreatePacket(packet);
-					sparePlayer->tcpSocket.send(packet);
+			// threadedNet can be switched off to see what socket I/O in the tick costs
+			if (threadedNet != netThreadRunning()) [[unlikely]] {
+				if (threadedNet) {
+					startNetThread();
+				} else {
+					stopNetThread();
 				}
-
-				sparePlayer->entity = new Triangle();
-				setupShip(sparePlayer->entity);
-				sparePlayer->entity->player = sparePlayer;
-				sparePlayer->entity->syncCreation();
-				sf::Packet entityAssign;
-				entityAssign << Packets::AssignEntity << sparePlayer->entity->id;
-				sparePlayer->tcpSocket.send(entityAssign);
-				for (Player* p: playerGroup) {
-					sf::Packet namePacket;
-					namePacket << Packets::Name << p->entity->id << p->username;
-					sparePlayer->tcpSocket.send(namePacket);
+			}
+			if (!threadedNet) {
+				pollNetwork();
+			}
+			NetEvent event;
+			while (netEvents.pop(event)) {
+				Player* player = event.player;
+				switch (event.type) {
+				case NetEvent::Connected:
+					joinPlayer(player);
+					break;
+				case NetEvent::Received:
+					if (!player->disconnected) {
+						player->lastAck = globalTime;
+						serverParsePacket(event.packet, player);
+					}
+					break;
+				case NetEvent::Datagram:
+					serverParseDatagram(event.packet, event.address, event.port);
+					break;
+				case NetEvent::Disconnected:
+					if (!player->disconnected) {
+						printf("Player %s %s.\n", player->name().c_str(), event.reason);
+						player->close();
+					}
+					break;
+				case NetEvent::Closed:
+					delete player;
+					break;
 				}
-				sparePlayer = new Player;
-			} else if (status != sf::Socket::NotReady) {
-				printf("An incoming connection has failed.\n");
 			}
+			updateLoadTest();
 		} else {
 			if (window->hasFocus()) {
 				mousePos = sf::Mouse::getPosition(*window);
@@ -309,13 +476,13 @@ int main(int argc, char** argv) {
 						double minDst = DBL_MAX;
 						Entity* closestEntity = nullptr;
 						for (Entity* e : updateGroup) {
-							double dst = dst2(e->x - ownX - (mousePos.x - g_camera.w * 0.5) * g_camera.scale, e->y - ownY - (mousePos.y - g_camera.h * 0.5) * g_camera.scale) - e->radius * e->radius;
+							double dst = dst2(e->x() - ownX - (mousePos.x - g_camera.w * 0.5) * g_camera.scale, e->y() - ownY - (mousePos.y - g_camera.h * 0.5) * g_camera.scale) - e->radius() * e->radius();
 							if (dst < minDst) {
 								minDst = dst;
 								closestEntity = e;
 							}
 						}
-						if (dst2(systemCenter->x - ownX - (mousePos.x - g_camera.w * 0.5) * g_camera.scale, systemCenter->y - ownY - (mousePos.y - g_camera.h * 0.5) * g_camera.scale) < minDst) {
+						if (dst2(systemCenter->x() - ownX - (mousePos.x - g_camera.w * 0.5) * g_camera.scale, systemCenter->y() - ownY - (mousePos.y - g_camera.h * 0.5) * g_camera.scale) < minDst) {
 							closestEntity = systemCenter;
 						}
 						if (closestEntity == trajectoryRef) {
@@ -361,38 +528,33 @@ int main(int argc, char** argv) {
 				}
 			}
 
+			stepWorld();
+			// draw in between the last two steps by the time left over after them, so motion stays smooth when frames and steps don't line up
+			bool interpolating = fixedStep;
+			if (interpolating) {
+				bodies.beginInterpolation(std::min(stepAccumulator * tickRate, 1.0));
+			}
 			window->clear(sf::Color(16, 0, 32));
 			if (ownEntity) [[likely]] {
-				ownX = ownEntity->x;
-				ownY = ownEntity->y;
+				ownX = ownEntity->x();
+				ownY = ownEntity->y();
 				drawShiftX = -ownX, drawShiftY = -ownY;
 			}
 			g_camera.bindWorld();
 			g_camera.pos.x = 0;
 			g_camera.pos.y = 0;
-			trajectoryOffset = floor((globalTime - lastPredict) / predictDelta * 60.0);
-			for (size_t i = 0; i < ghostTrajectories.size(); i++) {
-				std::vector<Point>& traj = ghostTrajectories[i];
-				if (lastTrajectoryRef && traj.size() > 0) [[likely]] {
-					sf::Color trajColor = ghostTrajectoryColors[i];
-					sf::VertexArray lines(sf::LineStrip, traj.size());
-					float lastAlpha = 255;
-					float decBy = (255.f - 64.f) / traj.size();
-					for (size_t i = 0; i < traj.size(); i++) {
-						Point point = traj[i];
-						lines[i].position = sf::Vector2f(lastTrajectoryRef->x + point.x + drawShiftX, lastTrajectoryRef->y + point.y + drawShiftY);
-						lines[i].color = trajColor;
-						lines[i].color.a = lastAlpha;
-						lastAlpha -= decBy;
-					}
-					window->draw(lines);
+			if (lastTrajectoryRef) [[likely]] {
+				for (size_t i = 0; i < ghostTrajectories.size(); i++) {
+					std::vector<Point>& traj = ghostTrajectories[i];
+					size_t from = std::partition_point(traj.begin(), traj.end(), [](const Point& p) { return p.time < globalTime; }) - traj.begin();
+					ghostLines.draw(i, from, lastTrajectoryRef->x() + drawShiftX, lastTrajectoryRef->y() + drawShiftY);
 				}
 			}
 			if (!stars.empty()) {
 				double x = 0.0, y = 0.0;
 				for (Attractor* star : stars) {
-					x += star->x;
-					y += star->y;
+					x += star->x();
+					y += star->y();
 				}
 				x /= stars.size();
 				y /= stars.size();
@@ -401,48 +563,46 @@ int main(int argc, char** argv) {
 			for (size_t i = 0; i < updateGroup.size(); i++) {
 				updateGroup[i]->draw();
 			}
-			if (ownEntity) {
-				if (lockControls) {
-					unsigned char zero = 0;
-					ownEntity->control(*(movement*)&zero);
-				} else {
-					ownEntity->control(controls);
-				}
-			}
+			worldBatch.flush();
 			g_camera.bindUI();
+			uiBatch.flush();
+			labelBatch.flush();
 
-			std::string info = "";
-			info.append("FPS: ").append(std::to_string(framerate))
-			.append("\nPing: ").append(std::to_string((int)(lastPing * 1000.0))).append("ms");
+			// text is only laid out again when it changes, most frames just copy the glyph quads
+			static TextLayout infoLayout, messageLayouts[displayMessageCount], chatLayout;
+			char info[192];
+			int length = snprintf(info, sizeof(info), "FPS: %lld\nPing: %dms", framerate, (int)(lastPing * 1000.0));
 			if (lastTrajectoryRef) {
-				info.append("\nDistance: ").append(std::to_string((int)(dst(ownX - lastTrajectoryRef->x, ownY - lastTrajectoryRef->y))));
+				length += snprintf(info + length, sizeof(info) - length, "\nDistance: %d", (int)(dst(ownX - lastTrajectoryRef->x(), ownY - lastTrajectoryRef->y())));
 				if (ownEntity) [[likely]] {
-					info.append("\nVelocity: ").append(std::to_string((int)(dst(ownEntity->velX - lastTrajectoryRef->velX, ownEntity->velY - lastTrajectoryRef->velY) * 60.0)));
+					snprintf(info + length, sizeof(info) - length, "\nVelocity: %d", (int)(dst(ownEntity->velX() - lastTrajectoryRef->velX(), ownEntity->velY() - lastTrajectoryRef->velY()) * 60.0));
 				}
 			}
-			posInfo->setString(info);
-			window->draw(*posInfo);
+			infoLayout.set(info, textCharacterSize);
+			hudBatch.add(infoLayout, 0.f, 0.f, sf::Color::White);
 			if (lastTrajectoryRef) {
-				float radius = std::max(5.f, (float)(lastTrajectoryRef->radius / g_camera.scale));
+				float radius = std::max(5.f, (float)(lastTrajectoryRef->radius() / g_camera.scale));
 				sf::CircleShape selection(radius, 4);
 				selection.setOrigin(radius, radius);
-				selection.setPosition(g_camera.w * 0.5 + (lastTrajectoryRef->x - ownX) / g_camera.scale, g_camera.h * 0.5 + (lastTrajectoryRef->y - ownY) / g_camera.scale);
+				selection.setPosition(g_camera.w * 0.5 + (lastTrajectoryRef->x() - ownX) / g_camera.scale, g_camera.h * 0.5 + (lastTrajectoryRef->y() - ownY) / g_camera.scale);
 				selection.setFillColor(sf::Color(0, 0, 0, 0));
 				selection.setOutlineColor(sf::Color(255, 255, 64));
 				selection.setOutlineThickness(1.f);
 				window->draw(selection);
 			}
-			std::string chatString = "";
-			for (int i = messageCursorPos; i < messageCursorPos + displayMessageCount; i++) {
-				std::string message = storedMessages[i];
-				chatString.append(message).append("\n");
+			float chatY = g_camera.h - (textCharacterSize + 4) * (displayMessageCount + 1), lineSpacing = font->getLineSpacing(textCharacterSize);
+			for (int i = 0; i < displayMessageCount; i++) {
+				messageLayouts[i].set(storedMessages[messageCursorPos + i], textCharacterSize);
+				hudBatch.add(messageLayouts[i], 2.f, chatY + i * lineSpacing, sf::Color::White);
 			}
-			chatString.append(chatBuffer);
-			chat->setString(chatString);
-			chat->setPosition(2, g_camera.h - (textCharacterSize + 4) * (displayMessageCount + 1));
-			window->draw(*chat);
+			chatLayout.set(chatBuffer, textCharacterSize);
+			hudBatch.add(chatLayout, 2.f, chatY + displayMessageCount * lineSpacing, sf::Color::White);
+			hudBatch.flush();
 			g_camera.bindWorld();
 			window->display();
+			if (interpolating) {
+				bodies.endInterpolation();
+			}
 
 			sf::Socket::Status status = sf::Socket::Done;
 			while (status != sf::Socket::NotReady) {
@@ -458,6 +618,7 @@ int main(int argc, char** argv) {
 					connectToServer();
 				}
 			}
+			clientReceiveUdp();
 			if (ownEntity && lastControls != controls && !lockControls) {
 				sf::Packet controlsPacket;
 				controlsPacket << Packets::Controls << *(unsigned char*) &controls;
@@ -466,227 +627,142 @@ int main(int argc, char** argv) {
 			}
 		}
 
-		double x1 = +INFINITY, y1 = +INFINITY, x2 = -INFINITY, y2 = -INFINITY;
-		for (Entity* e : updateGroup) {
-			x1 = std::min(e->x, x1);
-			y1 = std::min(e->y, y1);
-			x2 = std::max(e->x, x2);
-			y2 = std::max(e->y, y2);
-		}
-		quadtree[0] = Quad();
-		quadtree[0].x = x1;
-		quadtree[0].y = y1;
-		quadtree[0].size = std::max(x2 - x1, y2 - y1);
-		quadsConstructed = 1;
-		for (Entity* e : updateGroup) {
-			quadtree[0].put(e);
-		}
-		for (Entity* e : updateGroup) {
-			e->update1();
-		}
-		for (Entity* e : updateGroup) {
-			e->update2();
+		if (headless) {
+			stepWorld();
+		} else {
+			// the prediction thread works on a copy, the world goes on meanwhile
+			static PredictJob predictJob;
+			applyPrediction();
+			if (globalTime - lastPredictRequest > predictSpacing && trajectoryRef && !predictionBusy()) [[unlikely]] {
+				snapshotPrediction(predictJob);
+				requestPrediction(predictJob);
+				lastPredictRequest = globalTime;
+			}
 		}
-
-		if (headless && lastSweep + projectileSweepSpacing < globalTime) {
-			for (Entity* e : updateGroup) {
-				if (e->type() != Entities::Projectile) {
+		if (headless) {
+			for (Player* player : playerGroup) {
+				if (player->disconnected) {
 					continue;
 				}
-				double closest = DBL_MAX;
-				for (Player* p : playerGroup) {
-					if (!p->entity) {
-						continue;
-					}
-					closest = std::min(closest, dst2(e->x - p->entity->x, e->y - p->entity->y));
+				if (globalTime - player->lastAck > maxAckTime) {
+					printf("Player %s's connection has timed out.\n", player->name().c_str());
+					player->close();
+					continue;
 				}
-				if (closest > sweepThreshold && std::find(entityDeleteBuffer.begin(), entityDeleteBuffer.end(), e) == entityDeleteBuffer.end()) {
-					entityDeleteBuffer.push_back(e);
+				if (globalTime - player->lastAck > 1.0 && globalTime - player->lastPingSent > 1.0) {
+					sf::Packet pingPacket;
+					pingPacket << Packets::Ping;
+					player->send(pingPacket);
+					player->lastPingSent = globalTime;
 				}
 			}
-			lastSweep = globalTime;
-		}
-		for (Entity* e : entityDeleteBuffer) {
-			delete e;
-		}
-		entityDeleteBuffer.clear();
-		if (!headless && globalTime - lastPredict > predictSpacing && trajectoryRef) [[unlikely]] {
-			double resdelta = delta;
-			double resTime = globalTime;
-			std::vector<Entity*> retUpdateGroup(updateGroup);
-			delta = predictDelta;
-			simulating = true;
-			ghostTrajectories.clear();
-			ghostTrajectoryColors.clear();
-			bool controlsActive = *(unsigned char*) &controls != 0;
-			Triangle* ghost = nullptr;
-			if (ownEntity && controlsActive) {
-				ghost = new Triangle();
-				ghost->x = ownEntity->x;
-				ghost->y = ownEntity->y;
-				ghost->velX = ownEntity->velX;
-				ghost->velY = ownEntity->velY;
-				std::copy(std::begin(ownEntity->color), std::end(ownEntity->color), std::begin(ghost->color));
-				simCleanupBuffer.push_back(ghost);
+
+			std::vector<Player*> syncing;
+			for (Player* player : playerGroup) {
+				// a client that can't keep up gets synced less instead of filling its buffer with snapshots
+				if (globalTime - player->lastSynced > syncSpacing && !player->disconnected && player->queued < (size_t)sendBufferSize / 4) {
+					syncing.push_back(player);
+				}
 			}
-			for (Entity* e : updateGroup) {
-				e->simSetup();
-				e->trajectory.clear();
+			if (interestSync && !syncing.empty()) {
+				indexInterest(syncing);
 			}
-			for (int i = 0; i < predictSteps; i++) {
-				predictingFor = predictDelta * predictSteps;
-				globalTime += predictDelta / 60.0;
-				for (size_t i = 0; i < updateGroup.size(); i++) {
-					updateGroup[i]->update1();
-				}
-				for (size_t i = 0; i < updateGroup.size(); i++) {
-					updateGroup[i]->update2();
-				}
-				if (!stars.empty()) [[likely]] {
-					double x = 0.0, y = 0.0;
-					for (Attractor* star : stars) {
-						x += star->x;
-						y += star->y;
-					}
-					x /= stars.size();
-					y /= stars.size();
-					systemCenter->setPosition(x, y);
-				}
-				for (Entity* e : updateGroup) {
-					e->trajectory.push_back({e->x - trajectoryRef->x, e->y - trajectoryRef->y});
-				}
-				if (ownEntity) {
-					ownEntity->control(controls);
-				}
-				for (Entity* en : entityDeleteBuffer) {
-					for (size_t i = 0; i < updateGroup.size(); i++) {
-						Entity* e = updateGroup[i];
-						if (e == en) [[unlikely]] {
-							updateGroup[i] = updateGroup[updateGroup.size() - 1];
-							updateGroup.pop_back();
-						} else {
-							for (size_t i = 0; i < e->near.size(); i++){
-								if (e->near[i] == en) [[unlikely]] {
-									e->near[i] = e->near[e->near.size() - 1];
-									e->near.pop_back();
-									break;
-								}
+			// serialize every player's sync on the job threads, then send in order
+			parallelFor(syncing.size(), 1, [&](size_t from, size_t to) {
+				for (size_t i = from; i < to; i++) {
+					Player* player = syncing[i];
+					bool fullsync = !interestSync && player->lastFullsynced + fullsyncSpacing < globalTime;
+					std::vector<Entity*> visible, leaving;
+					if (interestSync) {
+						selectInterest(player, visible, leaving);
+					} else {
+						for (Entity* e : updateGroup) {
+							// clients move these themselves
+							if (bodies.rails[e->body]) {
+								continue;
 							}
+							if (player->entity && !fullsync && (abs(e->y() - player->entity->y()) - syncCullOffset > player->viewH * syncCullThreshold || abs(e->x() - player->entity->x()) - syncCullOffset > player->viewW * syncCullThreshold)) {
+								continue;
+							}
+							visible.push_back(e);
 						}
 					}
-				}
-				entityDeleteBuffer.clear();
-			}
-			for (Entity* en : simCleanupBuffer) {
-				ghostTrajectories.push_back(en->trajectory);
-				ghostTrajectoryColors.push_back(sf::Color(en->color[0] * 0.7, en->color[1] * 0.7, en->color[2] * 0.7));
-				entityDeleteBuffer.push_back(en);
-			}
-			simCleanupBuffer.clear();
-			updateGroup = retUpdateGroup;
-			for (Entity* e : updateGroup) {
-				e->simReset();
-			}
-			delta = resdelta;
-			simulating = false;
-			globalTime = resTime;
-			lastPredict = globalTime;
-			lastTrajectoryRef = trajectoryRef;
-		}
-		if (headless) {
-			int to = playerGroup.size();
-			for (int i = 0; i < to; i++) {
-				Player* player = playerGroup.at(i);
-				if (globalTime - player->lastAck > 1.0 && globalTime - player->lastPingSent > 1.0) {
-					if (globalTime - player->lastAck > maxAckTime) {
-						printf("Player %s's connection has timed out.\n", player->name().c_str());
-						playerGroup.erase(playerGroup.begin() + i);
-						i--;
-						to--;
-						player->tcpSocket.disconnect();
-						delete player;
-						continue;
+					if (!leaving.empty()) {
+						loadSleep(player->tcpQueue.emplace_back(), leaving);
 					}
-
-					sf::Packet pingPacket;
-					pingPacket << Packets::Ping;
-					sf::Socket::Status status = player->tcpSocket.send(pingPacket);
-					if (status != sf::Socket::Done) {
-						if (status == sf::Socket::Disconnected) {
-							printf("Player %s has disconnected.\n", player->name().c_str());
-							playerGroup.erase(playerGroup.begin() + i);
-							i--;
-							to--;
-							player->tcpSocket.disconnect();
-							delete player;
-							continue;
-						}
-
-						if (status == sf::Socket::Error) {
-							printf("Error when trying to send ping packet to player %s.\n", player->name().c_str());
+					std::vector<sf::Packet>& snapshotQueue = udpSync && player->udpPort ? player->udpQueue : player->tcpQueue;
+					std::vector<sf::Packet>& written = batchSync ? snapshotQueue : player->tcpQueue;
+					size_t queuedBefore = written.size();
+					if (batchSync && deltaSync) {
+						loadDeltaSnapshot(snapshotQueue.emplace_back(), player, visible);
+					} else if (batchSync) {
+						loadSnapshot(snapshotQueue.emplace_back(), visible);
+					} else {
+						for (Entity* e : visible) {
+							sf::Packet& packet = player->tcpQueue.emplace_back();
+							packet << Packets::SyncEntity;
+							e->loadSyncPacket(packet);
 						}
+						sf::Packet& syncDone = player->tcpQueue.emplace_back();
+						syncDone << Packets::SyncDone;
 					}
-					player->lastPingSent = globalTime;
-				}
-
-				sf::Socket::Status status = sf::Socket::Done;
-				while (status != sf::Socket::NotReady && status != sf::Socket::Disconnected) {
-					sf::Packet packet;
-					player->tcpSocket.setBlocking(false);
-					status = player->tcpSocket.receive(packet);
-					player->tcpSocket.setBlocking(true);
-					if (status == sf::Socket::Done) [[likely]]{
-						player->lastAck = globalTime;
-						serverParsePacket(packet, player);
-					} else if (status == sf::Socket::Disconnected) {
-						printf("Player %s has disconnected.\n", player->name().c_str());
-						i--;
-						to--;
-						player->tcpSocket.disconnect();
-						delete player;
-						goto egg;
-					}
-				}
-
-				if (globalTime - player->lastSynced > syncSpacing) {
-					bool fullsync = player->lastFullsynced + fullsyncSpacing < globalTime;
-					for (Entity* e : updateGroup) {
-						if (player->entity && !fullsync && (abs(e->y - player->entity->y) - syncCullOffset > player->viewH * syncCullThreshold || abs(e->x - player->entity->x) - syncCullOffset > player->viewW * syncCullThreshold)) {
-							continue;
+					// how much the budget of the next one buys
+					if (!visible.empty()) {
+						size_t bytes = 0;
+						for (size_t p = queuedBefore; p < written.size(); p++) {
+							bytes += written[p].getDataSize();
 						}
-						sf::Packet packet;
-						packet << Packets::SyncEntity;
-						e->loadSyncPacket(packet);
-						player->tcpSocket.send(packet);
+						player->stateCost = player->stateCost * 0.75 + (double)bytes / visible.size() * 0.25;
 					}
-					sf::Packet syncDone;
-					syncDone << Packets::SyncDone;
-					player->tcpSocket.send(syncDone);
 					player->lastSynced = globalTime;
 					if (fullsync) {
 						player->lastFullsynced = globalTime;
 					}
 				}
-
-				if (player->entity) {
-					player->entity->control(player->controls);
+			});
+			for (Player* player : syncing) {
+				for (sf::Packet& packet : player->tcpQueue) {
+					player->send(packet);
 				}
-
-			egg:
-				continue;
+				player->tcpQueue.clear();
+				for (sf::Packet& packet : player->udpQueue) {
+					sendUdp(player, packet);
+				}
+				player->udpQueue.clear();
 			}
 		}
 
-		delta = deltaClock.restart().asSeconds() * 60.0;
+		double work = tickClock.getElapsedTime().asSeconds();
+		measureWork += work;
+		measureWork2 += work * work;
+		measureWorstTick = std::max(measureWorstTick, work);
+		double elapsed = deltaClock.restart().asSeconds();
+		delta = elapsed * 60.0;
+		if (fixedStep) {
+			stepAccumulator += elapsed;
+		}
 		measureFrames++;
 		if (globalTime > lastShowFramerate + 1.0) {
 			lastShowFramerate = globalTime;
 			framerate = measureFrames;
+			tickTime = measureWork / measureFrames;
+			tickJitter = sqrt(std::max(measureWork2 / measureFrames - tickTime * tickTime, 0.0));
+			worstTick = measureWorstTick;
 			measureFrames = 0;
+			measureWork = measureWork2 = measureWorstTick = 0.0;
+		}
+		if (headless && fixedStep) {
+			// the server only has to wake up for the next step
+			sf::sleep(sf::seconds(std::max(1.0 / tickRate - stepAccumulator, 0.0)));
+		} else {
+			sf::sleep(sf::seconds(std::max((1.0 / targetFramerate - delta / 60.0), 0.0)));
 		}
-		sf::sleep(sf::seconds(std::max((1.0 / targetFramerate - delta / 60.0), 0.0)));
 		globalTime = globalClock.getElapsedTime().asSeconds();
+		tickClock.restart();
 	}
 
+	stopNetThread();
+	stopPrediction();
+	stopJobs();
 	return 0;
 }
@@ -1,18 +1,147 @@
 #include "camera.hpp"
 #include "entities.hpp"
 #include "globals.hpp"
+#include "idmap.hpp"
+#include "math.hpp"
 #include "net.hpp"
+#include "netio.hpp"
 #include "strings.hpp"
 #include "types.hpp"
 
 #include <SFML/Network.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <random>
+#include <string>
 
 using namespace obf;
 
 namespace obf {
 
+// snapshots received from the server
+static SnapshotReceiver received;
+
+static const SyncFrame* findFrame(const SyncFrame* frames, size_t count, uint32_t tick) {
+    for (size_t i = 0; i < std::min(count, syncHistory); i++) {
+        if (frames[i].tick == tick) {
+            return &frames[i];
+        }
+    }
+    return nullptr;
+}
+
+// udp acks can come in out of order, keep the newest, a failed one makes the next snapshot go whole
+static void ackSnapshot(SnapshotSender& sender, uint32_t tick, bool decoded) {
+    if (!decoded) {
+        sender.acked = false;
+    } else if (!sender.acked || (int32_t)(tick - sender.ackedTick) > 0) {
+        sender.ackedTick = tick;
+        sender.acked = true;
+    }
+}
+
+// the slot the next snapshot to sender goes in, base is the newest one it acked to encode it against
+static SyncFrame& nextFrame(SnapshotSender& sender, const SyncFrame*& base) {
+    // find the base before its slot could be reused for this snapshot
+    base = sender.acked ? findFrame(sender.frames, sender.sent, sender.ackedTick) : nullptr;
+    SyncFrame& frame = sender.frames[sender.sent++ % syncHistory];
+    if (&frame == base) {
+        base = nullptr;
+    }
+    return frame;
+}
+
+static void writeDelta(sf::Packet& packet, const SyncFrame* base, SyncFrame& frame) {
+    std::string data;
+    encodeFrame(data, base, frame);
+    packet << Packets::DeltaSnapshot << frame.tick << (base ? base->tick : frame.tick) << data;
+}
+
+// reads a Packets::DeltaSnapshot after its type, false if it's older than one already taken
+// otherwise tick is what to ack and frame is the decoded snapshot, kept in receiver, or null if it couldn't be decoded
+static bool readDelta(sf::Packet& packet, SnapshotReceiver& receiver, uint32_t& tick, const SyncFrame*& frame) {
+    uint32_t baseTick;
+    std::string data;
+    packet >> tick >> baseTick >> data;
+    frame = nullptr;
+    if ((int32_t)(tick - receiver.lastTick) < 0) [[unlikely]] {
+        return false;
+    }
+    // the base tick is the snapshot's own tick when it's sent whole
+    const SyncFrame* base = nullptr;
+    if (baseTick != tick) {
+        base = findFrame(receiver.frames, receiver.received, baseTick);
+    }
+    SyncFrame decoded;
+    if ((base || baseTick == tick) && decodeFrame(data, base, decoded)) [[likely]] {
+        receiver.lastTick = tick;
+        decoded.tick = tick;
+        SyncFrame& slot = receiver.frames[receiver.received++ % syncHistory];
+        slot = std::move(decoded);
+        frame = &slot;
+    }
+    return true;
+}
+
+// datagrams from the server carry a sequence number, false for ones not newer than the newest taken
+static bool freshDatagram(uint32_t sequence, uint32_t& newest, bool& any) {
+    if (any && (int32_t)(sequence - newest) <= 0) {
+        return false;
+    }
+    newest = sequence;
+    any = true;
+    return true;
+}
+
+void resetSync() {
+    received.received = 0;
+    received.lastTick = 0;
+    udpToken = 0;
+    udpSequence = 0;
+    udpSequenced = false;
+    udpConfirmed = false;
+}
+
+// move bodies a state came in for to it, the rest keep going on their own, ones on rails aren't synced
+static void applySync() {
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (!bodies.synced[i]) {
+            continue;
+        }
+        bodies.synced[i] = 0;
+        if (!bodies.active[i] || bodies.rails[i]) {
+            continue;
+        }
+        bodies.x[i] = bodies.syncX[i];
+        bodies.y[i] = bodies.syncY[i];
+        bodies.velX[i] = bodies.syncVelX[i];
+        bodies.velY[i] = bodies.syncVelY[i];
+    }
+}
+
+// the fixed size records of loadSnapshot() and loadSleep()
+static void unloadStates(sf::Packet& packet, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t entityID;
+        double x, y, velX, velY, rotation;
+        packet >> entityID >> x >> y >> velX >> velY >> rotation;
+        if (!packet) [[unlikely]] {
+            printf("Truncated snapshot, got %u of %u entities\n", i, count);
+            break;
+        }
+        if (Entity* e = entityMap.get(entityID)) {
+            e->syncX() = x;
+            e->syncY() = y;
+            e->syncVelX() = velX;
+            e->syncVelY() = velY;
+            e->rotation = rotation;
+            bodies.synced[e->body] = 1;
+        }
+    }
+}
+
 void clientParsePacket(sf::Packet& packet) {
     uint16_t type;
     packet >> type;
@@ -65,53 +194,115 @@ void clientParsePacket(sf::Packet& packet) {
     case Packets::SyncEntity: {
         uint32_t entityID;
         packet >> entityID;
-        for (Entity* e : updateGroup) {
-            if (e->id == entityID) [[unlikely]] {
-                e->unloadSyncPacket(packet);
-                break;
-            }
+        if (Entity* e = entityMap.get(entityID)) {
+            e->unloadSyncPacket(packet);
+            bodies.synced[e->body] = 1;
         }
         break;
     }
-    case Packets::SyncDone: {
-        for (Entity* e: updateGroup) {
-            e->x = e->syncX;
-            e->y = e->syncY;
-            e->velX = e->syncVelX;
-            e->velY = e->syncVelY;
+    case Packets::SyncDone:
+        applySync();
+        break;
+    case Packets::Derail: {
+        uint32_t entityID;
+        double x, y, velX, velY;
+        packet >> entityID >> x >> y >> velX >> velY;
+        if (Entity* e = entityMap.get(entityID)) {
+            bodies.rails[e->body] = 0;
+            e->setPosition(x, y);
+            e->setVelocity(velX, velY);
+            e->syncX() = x;
+            e->syncY() = y;
+            e->syncVelX() = velX;
+            e->syncVelY() = velY;
+        }
+        break;
+    }
+    case Packets::Snapshot: {
+        uint32_t tick, count;
+        packet >> tick >> count;
+        // drop snapshots older than one already applied, wraparound safe
+        if ((int32_t)(tick - received.lastTick) < 0) [[unlikely]] {
+            break;
         }
+        received.lastTick = tick;
+        unloadStates(packet, count);
+        applySync();
         break;
     }
+    case Packets::Sleep: {
+        // these left what the server syncs us, they're simulated here from this last state until they come back
+        uint32_t count;
+        packet >> count;
+        unloadStates(packet, count);
+        applySync();
+        break;
+    }
+    case Packets::DeltaSnapshot: {
+        uint32_t tick;
+        const SyncFrame* frame;
+        if (!readDelta(packet, received, tick, frame)) {
+            break;
+        }
+        bool decoded = frame;
+        sf::Packet ackPacket;
+        if (udpConfirmed) {
+            ackPacket << udpToken << Packets::SnapshotAck << tick << decoded;
+            udpSocket->send(ackPacket, serverSocket->getRemoteAddress(), serverSocket->getRemotePort());
+        } else {
+            ackPacket << Packets::SnapshotAck << tick << decoded;
+            serverSocket->send(ackPacket);
+        }
+        if (!decoded) [[unlikely]] {
+            // the server will send the next one whole
+            printf("Could not decode snapshot %u\n", tick);
+            break;
+        }
+        for (const SyncState& s : frame->states) {
+            if (Entity* e = entityMap.get(s.id)) {
+                dequantizeState(s, e->syncX(), e->syncY(), e->syncVelX(), e->syncVelY(), e->rotation);
+                bodies.synced[e->body] = 1;
+            }
+        }
+        applySync();
+        break;
+    }
+    case Packets::UdpToken:
+        packet >> udpToken;
+        if (!udpSocket) {
+            udpSocket = new sf::UdpSocket;
+            udpSocket->setBlocking(false);
+            if (udpSocket->bind(sf::Socket::AnyPort) != sf::Socket::Done) {
+                printf("Could not open a udp socket, syncing over tcp only.\n");
+                delete udpSocket;
+                udpSocket = nullptr;
+                break;
+            }
+        }
+        udpConfirmed = false;
+        lastUdpHello = -1.0;
+        break;
     case Packets::AssignEntity: {
         uint32_t entityID;
         packet >> entityID;
-        for (Entity* e : updateGroup) {
-            if (e->id == entityID) [[unlikely]] {
-                ownEntity = e;
-                break;
-            }
+        if (Entity* e = entityMap.get(entityID)) {
+            ownEntity = e;
         }
         break;
     }
     case Packets::DeleteEntity: {
         uint32_t deleteID;
         packet >> deleteID;
-        for (Entity* e : updateGroup) {
-            if (e->id == deleteID) [[unlikely]] {
-                delete e;
-                break;
-            }
+        if (Entity* e = entityMap.get(deleteID)) {
+            delete e;
         }
         break;
     }
     case Packets::ColorEntity: {
         uint32_t id;
         packet >> id;
-        for (Entity* e : updateGroup) {
-            if (e->id == id) [[unlikely]] {
-                packet >> e->color[0] >> e->color[1] >> e->color[2];
-                break;
-            }
+        if (Entity* e = entityMap.get(id)) {
+            packet >> e->color[0] >> e->color[1] >> e->color[2];
         }
         break;
     }
@@ -127,25 +318,17 @@ void clientParsePacket(sf::Packet& packet) {
     case Packets::Name: {
         uint32_t id;
         packet >> id;
-        for (Entity* e : updateGroup) {
-            if (e->id == id) [[unlikely]] {
-                packet >> ((Triangle*)e)->name;
-                break;
-            }
+        if (Entity* e = entityMap.get(id)) {
+            packet >> ((Triangle*)e)->name;
         }
         break;
     }
     case Packets::PlanetCollision: {
         uint32_t id;
         packet >> id;
-        for (Entity* e : updateGroup) {
-            if (e->id == id) [[unlikely]] {
-                Attractor* at = (Attractor*)e;
-                packet >> at->mass >> at->radius;
-                at->shape->setRadius(at->radius);
-                at->shape->setOrigin(at->radius, at->radius);
-                break;
-            }
+        if (Entity* e = entityMap.get(id)) {
+            Attractor* at = (Attractor*)e;
+            packet >> at->mass() >> at->radius();
         }
         break;
     }
@@ -166,7 +349,7 @@ void serverParsePacket(sf::Packet& packet, Player* player) {
         player->ping = globalTime - player->lastPingSent;
         sf::Packet pingInfoPacket;
         pingInfoPacket << Packets::PingInfo << player->ping;
-        player->tcpSocket.send(pingInfoPacket);
+        player->send(pingInfoPacket);
         break;
     }
     case Packets::Nickname: {
@@ -189,8 +372,8 @@ void serverParsePacket(sf::Packet& packet, Player* player) {
         sf::Packet namePacket;
         namePacket << Packets::Name << player->entity->id << player->username;
         for (Player* p : playerGroup) {
-            p->tcpSocket.send(colorPacket);
-            p->tcpSocket.send(namePacket);
+            p->send(colorPacket);
+            p->send(namePacket);
         }
         std::string sendMessage;
         sendMessage.append("<").append(player->name()).append("> has joined.");
@@ -215,19 +398,279 @@ void serverParsePacket(sf::Packet& packet, Player* player) {
     case Packets::ResizeView:
         packet >> player->viewW >> player->viewH;
         break;
+    case Packets::SnapshotAck: {
+        uint32_t tick;
+        bool decoded;
+        packet >> tick >> decoded;
+        ackSnapshot(player->snapshots, tick, decoded);
+        break;
+    }
     default:
         printf("Illegal packet %d\n", type);
         break;
     }
 }
 
+void loadSnapshot(sf::Packet& packet, const std::vector<Entity*>& entities) {
+    // every entity gets the same fixed size record so unknown IDs can be skipped
+    packet << Packets::Snapshot << tickCount << (uint32_t)entities.size();
+    for (Entity* e : entities) {
+        packet << e->id << e->x() << e->y() << e->velX() << e->velY() << e->rotation;
+    }
+}
+
+void loadSleep(sf::Packet& packet, const std::vector<Entity*>& entities) {
+    packet << Packets::Sleep << (uint32_t)entities.size();
+    for (Entity* e : entities) {
+        packet << e->id << e->x() << e->y() << e->velX() << e->velY() << e->rotation;
+    }
+}
+
+void loadDeltaSnapshot(sf::Packet& packet, Player* player, std::vector<Entity*>& entities) {
+    std::sort(entities.begin(), entities.end(), [](Entity* a, Entity* b) {
+        return a->id < b->id;
+    });
+    const SyncFrame* base;
+    SyncFrame& frame = nextFrame(player->snapshots, base);
+    frame.tick = tickCount;
+    frame.time = llround(globalTime * syncTimeScale);
+    frame.states.clear();
+    double viewW = std::max(player->viewW, 1.0), viewH = std::max(player->viewH, 1.0);
+    for (Entity* e : entities) {
+        SyncState& s = frame.states.emplace_back(quantizeState(e->id, e->x(), e->y(), e->velX(), e->velY(), e->rotation));
+        // on screen positions are precise to a fraction of the view, further out precision drops off with distance
+        double views = 1.0;
+        if (player->entity) {
+            views = std::max({fabs(e->x() - player->entity->x()) / viewW, fabs(e->y() - player->entity->y()) / viewH, 1.0});
+        }
+        double step = std::max(viewW, viewH) / syncPrecision * views * syncPosScale;
+        s.coarseness = step >= 2.0 ? (uint8_t)std::min((int)log2(step), maxCoarseness) : 0;
+    }
+    writeDelta(packet, base, frame);
+}
+
+uint32_t newUdpToken() {
+    static std::random_device source;
+    uint32_t token;
+    // 0 means no token
+    while (!(token = source())) {}
+    return token;
+}
+
+void sendUdp(Player* player, sf::Packet& packet) {
+    // snapshots too big for one datagram still have to get there
+    if (packet.getDataSize() + sizeof(uint32_t) > sf::UdpSocket::MaxDatagramSize) [[unlikely]] {
+        player->send(packet);
+        return;
+    }
+    NetCommand command(NetCommand::SendDatagram, player);
+    command.packet << player->udpSequence++;
+    command.packet.append(packet.getData(), packet.getDataSize());
+    command.address = player->udpAddress;
+    command.port = player->udpPort;
+    if (udpLoss > 0.0 && chance(udpLoss)) {
+        return;
+    }
+    netCommands.push(std::move(command));
+}
+
+void clientReceiveUdp() {
+    if (!udpSocket || !udpToken) {
+        return;
+    }
+    sf::IpAddress serverAddress = serverSocket->getRemoteAddress();
+    unsigned short serverPort = serverSocket->getRemotePort();
+    // keep saying hello until the server's datagrams start getting through
+    if (!udpConfirmed && globalTime - lastUdpHello > 1.0) {
+        sf::Packet hello;
+        hello << udpToken << Packets::UdpHello;
+        udpSocket->send(hello, serverAddress, serverPort);
+        lastUdpHello = globalTime;
+    }
+    sf::Packet packet;
+    sf::IpAddress address;
+    unsigned short port;
+    while (udpSocket->receive(packet, address, port) == sf::Socket::Done) {
+        uint32_t sequence;
+        if (address != serverAddress || port != serverPort || !(packet >> sequence)) [[unlikely]] {
+            continue;
+        }
+        udpConfirmed = true;
+        // anything older than what already arrived is out of date
+        if (!freshDatagram(sequence, udpSequence, udpSequenced)) {
+            continue;
+        }
+        clientParsePacket(packet);
+    }
+}
+
+void serverParseDatagram(sf::Packet& packet, const sf::IpAddress& address, unsigned short port) {
+    uint32_t token;
+    uint16_t type;
+    packet >> token >> type;
+    if (!packet || !token) [[unlikely]] {
+        return;
+    }
+    Player* player = nullptr;
+    for (Player* p : playerGroup) {
+        if (p->udpToken == token) {
+            player = p;
+            break;
+        }
+    }
+    if (!player || player->disconnected) {
+        return;
+    }
+    switch (type) {
+    case Packets::UdpHello:
+        if (debug) {
+            printf("Player %s is on udp port %u\n", player->name().c_str(), port);
+        }
+        player->udpAddress = address;
+        player->udpPort = port;
+        break;
+    case Packets::SnapshotAck: {
+        uint32_t tick;
+        bool decoded;
+        if (address == player->udpAddress && port == player->udpPort && packet >> tick >> decoded) {
+            ackSnapshot(player->snapshots, tick, decoded);
+        }
+        break;
+    }
+    default:
+        // everything else has to come over tcp
+        break;
+    }
+}
+
 void relayMessage(std::string& message) {
     sf::Packet chatPacket;
     std::cout << message << std::endl;
     chatPacket << Packets::Chat << message;
     for (Player* p : playerGroup) {
-        p->tcpSocket.send(chatPacket);
+        p->send(chatPacket);
+    }
+}
+
+bool testUdpSync(std::string& report) {
+    sf::UdpSocket server, client;
+    if (server.bind(sf::Socket::AnyPort, sf::IpAddress::LocalHost) != sf::Socket::Done || client.bind(sf::Socket::AnyPort, sf::IpAddress::LocalHost) != sf::Socket::Done) {
+        report.append("could not open loopback udp sockets\n");
+        return false;
+    }
+    server.setBlocking(false);
+    client.setBlocking(false);
+    unsigned short serverPort = server.getLocalPort(), clientPort = client.getLocalPort();
+
+    std::mt19937_64 rng(9133);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    double loss = udpLoss > 0.0 ? udpLoss : 0.2, reorder = 0.2, duplicate = 0.05;
+    // datagrams held back to go out after later ones, each way
+    std::vector<sf::Packet> heldDown, heldUp;
+    auto transmit = [&](sf::UdpSocket& from, unsigned short to, const sf::Packet& packet, std::vector<sf::Packet>& held) {
+        if (unit(rng) < loss) {
+            return;
+        }
+        if (unit(rng) < reorder) {
+            held.push_back(packet);
+            return;
+        }
+        sf::Packet copy = packet;
+        from.send(copy, sf::IpAddress::LocalHost, to);
+        if (unit(rng) < duplicate) {
+            from.send(copy, sf::IpAddress::LocalHost, to);
+        }
+        for (size_t i = 0; i < held.size();) {
+            if (unit(rng) < 0.5) {
+                from.send(held[i], sf::IpAddress::LocalHost, to);
+                held.erase(held.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    };
+
+    SnapshotSender sender;
+    SnapshotReceiver receiver;
+    uint32_t sequence = 0, newest = 0, lastApplied = 0;
+    bool sequenced = false, anyApplied = false;
+    size_t sent = 0, arrived = 0, outOfDate = 0, applied = 0, failed = 0, stale = 0, wrong = 0;
+    const size_t count = 200;
+    for (uint32_t f = 0; f < 600; f++) {
+        // server: bodies on circles, some left out like with interest management
+        const SyncFrame* base;
+        SyncFrame& frame = nextFrame(sender, base);
+        frame.tick = f;
+        frame.time = llround(f * 0.1 * syncTimeScale);
+        frame.states.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (unit(rng) < 0.05) {
+                continue;
+            }
+            double radius = 1.0e3 * (i + 1), a = f * 0.01 * (i % 7 + 1);
+            frame.states.push_back(quantizeState(i + 1, radius * cos(a), radius * sin(a), -radius * sin(a) * 0.01, radius * cos(a) * 0.01, f));
+        }
+        sf::Packet snapshot, datagram;
+        writeDelta(snapshot, base, frame);
+        datagram << sequence++;
+        datagram.append(snapshot.getData(), snapshot.getDataSize());
+        transmit(server, clientPort, datagram, heldDown);
+        sent++;
+        sf::sleep(sf::microseconds(200));
+
+        // client: take what got through the way clientReceiveUdp() and clientParsePacket() do, acking each
+        sf::Packet packet;
+        sf::IpAddress address;
+        unsigned short port;
+        while (client.receive(packet, address, port) == sf::Socket::Done) {
+            arrived++;
+            uint32_t datagramSequence, tick;
+            uint16_t type;
+            const SyncFrame* got;
+            if (!(packet >> datagramSequence) || !freshDatagram(datagramSequence, newest, sequenced) || !(packet >> type) || type != Packets::DeltaSnapshot || !readDelta(packet, receiver, tick, got)) {
+                outOfDate++;
+                continue;
+            }
+            sf::Packet ack;
+            ack << Packets::SnapshotAck << tick << (bool)got;
+            transmit(client, serverPort, ack, heldUp);
+            if (!got) {
+                failed++;
+                continue;
+            }
+            if (anyApplied && (int32_t)(tick - lastApplied) <= 0) {
+                stale++;
+            }
+            // the server's copy is still there unless it's more than syncHistory snapshots old
+            const SyncFrame& original = sender.frames[tick % syncHistory];
+            if (original.tick == tick) {
+                bool same = original.states.size() == got->states.size();
+                for (size_t i = 0; same && i < got->states.size(); i++) {
+                    const SyncState& a = original.states[i], & b = got->states[i];
+                    same = a.id == b.id && a.x == b.x && a.y == b.y && a.velX == b.velX && a.velY == b.velY && a.rotation == b.rotation;
+                }
+                wrong += !same;
+            }
+            lastApplied = tick;
+            anyApplied = true;
+            applied++;
+        }
+        // server: acks
+        while (server.receive(packet, address, port) == sf::Socket::Done) {
+            uint16_t type;
+            uint32_t tick;
+            bool decoded;
+            if (packet >> type >> tick >> decoded && type == Packets::SnapshotAck) {
+                ackSnapshot(sender, tick, decoded);
+            }
+        }
     }
+    bool ok = applied > 0 && !failed && !stale && !wrong;
+    char line[256];
+    snprintf(line, sizeof(line), "%s: %zu snapshots sent with %g loss, %zu datagrams arrived, %zu out of date, %zu applied, %zu failed to decode, %zu stale, %zu wrong\n",
+        ok ? "passed" : "FAILED", sent, loss, arrived, outOfDate, applied, failed, stale, wrong);
+    report.append(line);
+    return ok;
 }
 
 }
@@ -0,0 +1,214 @@
+#include "entities.hpp"
+#include "globals.hpp"
+#include "netio.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace obf {
+
+static std::thread netThread;
+static std::atomic<bool> netRunning = false;
+// owned by whichever thread does the network's work, handed over by starting and stopping it
+static sf::SocketSelector selector;
+static std::vector<Player*> netPlayers;
+static bool netSetUp = false;
+
+bool Player::send(sf::Packet& packet) {
+	if (disconnected) {
+		return false;
+	}
+	queued += packet.getDataSize() + sizeof(uint32_t);
+	netCommands.push(NetCommand(NetCommand::Send, this, packet));
+	return true;
+}
+
+void Player::close() {
+	if (disconnected) {
+		return;
+	}
+	disconnected = true;
+	netCommands.push(NetCommand(NetCommand::Close, this));
+}
+
+// network thread only from here on
+
+bool Player::buffer(const sf::Packet& packet) {
+	size_t size = packet.getDataSize();
+	if (outbound.size() != (size_t)sendBufferSize) [[unlikely]] {
+		// the ring only resizes while empty, sendBufferSize changing takes effect then
+		if (outSize == 0) {
+			outbound.resize(sendBufferSize);
+			outStart = 0;
+		}
+	}
+	if (outSize + sizeof(uint32_t) + size > outbound.size()) {
+		return false;
+	}
+	// big endian size first, the same framing sf::TcpSocket::send(sf::Packet&) uses
+	char header[4] = {(char)(size >> 24), (char)(size >> 16), (char)(size >> 8), (char)size};
+	auto write = [&](const char* data, size_t n) {
+		size_t end = (outStart + outSize) % outbound.size();
+		size_t first = std::min(n, outbound.size() - end);
+		memcpy(&outbound[end], data, first);
+		memcpy(&outbound[0], data + first, n - first);
+		outSize += n;
+	};
+	write(header, sizeof(header));
+	if (size) {
+		write((const char*)packet.getData(), size);
+	}
+	return true;
+}
+
+bool Player::flush() {
+	while (outSize) {
+		size_t chunk = std::min(outSize, outbound.size() - outStart), sent = 0;
+		sf::Socket::Status status = tcpSocket.send(&outbound[outStart], chunk, sent);
+		outStart = (outStart + sent) % outbound.size();
+		outSize -= sent;
+		queued -= sent;
+		if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+			return false;
+		} else if (status != sf::Socket::Done) {
+			// the socket's buffer is full, try again later
+			break;
+		}
+	}
+	return true;
+}
+
+static void hangUp(Player* player, const char* reason) {
+	selector.remove(player->tcpSocket);
+	player->tcpSocket.disconnect();
+	player->hungUp = true;
+	if (reason) {
+		netEvents.push(NetEvent(NetEvent::Disconnected, player, reason));
+	}
+}
+
+// one round of sends and receives, waits up to wait for something to arrive
+static void netPoll(sf::Time wait) {
+	NetCommand command;
+	while (netCommands.pop(command)) {
+		Player* player = command.player;
+		switch (command.type) {
+		case NetCommand::Send:
+			if (player->hungUp) {
+				break;
+			}
+			if (!player->buffer(command.packet)) {
+				hangUp(player, "isn't keeping up, dropping them");
+			}
+			break;
+		case NetCommand::SendDatagram:
+			udpSocket->send(command.packet, command.address, command.port);
+			break;
+		case NetCommand::Close:
+			if (!player->hungUp) {
+				hangUp(player, nullptr);
+			}
+			netPlayers.erase(std::find(netPlayers.begin(), netPlayers.end(), player));
+			netEvents.push(NetEvent(NetEvent::Closed, player));
+			break;
+		}
+	}
+	for (Player* player : netPlayers) {
+		if (!player->hungUp && !player->flush()) {
+			hangUp(player, "has disconnected");
+		}
+	}
+
+	if (!selector.wait(wait)) {
+		return;
+	}
+	if (selector.isReady(*connectListener)) {
+		sf::Socket::Status status;
+		while ((status = connectListener->accept(sparePlayer->tcpSocket)) == sf::Socket::Done) {
+			Player* player = sparePlayer;
+			player->tcpSocket.setBlocking(false);
+			player->ip = player->tcpSocket.getRemoteAddress().toString();
+			player->port = player->tcpSocket.getRemotePort();
+			selector.add(player->tcpSocket);
+			netPlayers.push_back(player);
+			netEvents.push(NetEvent(NetEvent::Connected, player));
+			sparePlayer = new Player;
+		}
+		if (status != sf::Socket::NotReady) {
+			printf("An incoming connection has failed.\n");
+		}
+	}
+	if (udpSocket && selector.isReady(*udpSocket)) {
+		NetEvent event;
+		event.type = NetEvent::Datagram;
+		while (udpSocket->receive(event.packet, event.address, event.port) == sf::Socket::Done) {
+			netEvents.push(std::move(event));
+			event = NetEvent();
+			event.type = NetEvent::Datagram;
+		}
+	}
+	for (Player* player : netPlayers) {
+		if (player->hungUp || !selector.isReady(player->tcpSocket)) {
+			continue;
+		}
+		NetEvent event;
+		sf::Socket::Status status;
+		while ((status = player->tcpSocket.receive(event.packet)) == sf::Socket::Done) {
+			event.player = player;
+			netEvents.push(std::move(event));
+			event = NetEvent();
+		}
+		if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+			hangUp(player, "has disconnected");
+		}
+	}
+}
+
+static void netLoop() {
+	while (netRunning.load(std::memory_order_relaxed)) {
+		// short enough that queued sends don't wait long
+		netPoll(sf::milliseconds(1));
+	}
+}
+
+static void setUpNet() {
+	if (netSetUp) {
+		return;
+	}
+	connectListener->setBlocking(false);
+	selector.add(*connectListener);
+	if (udpSocket) {
+		udpSocket->setBlocking(false);
+		selector.add(*udpSocket);
+	}
+	netSetUp = true;
+}
+
+void startNetThread() {
+	setUpNet();
+	netRunning = true;
+	netThread = std::thread(netLoop);
+}
+
+void stopNetThread() {
+	if (!netThread.joinable()) {
+		return;
+	}
+	netRunning = false;
+	netThread.join();
+}
+
+bool netThreadRunning() {
+	return netThread.joinable();
+}
+
+void pollNetwork() {
+	setUpNet();
+	// sf::Time::Zero would wait forever
+	netPoll(sf::microseconds(1));
+}
+
+}
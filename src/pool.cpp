@@ -0,0 +1,38 @@
+#include "pool.hpp"
+
+#include <algorithm>
+
+namespace obf {
+
+Pool::Pool(size_t size, size_t perSlab) {
+	// every slot has to fit the free list link and stay aligned like new would
+	constexpr size_t align = alignof(std::max_align_t);
+	this->size = (std::max(size, sizeof(void*)) + align - 1) / align * align;
+	this->perSlab = perSlab;
+}
+
+void* Pool::acquire() {
+	if (!freeList) [[unlikely]] {
+		storage.emplace_back(new char[size * perSlab]);
+		slabs++;
+		char* slab = storage.back().get();
+		// thread the new slots onto the free list, first slot first
+		for (size_t i = perSlab; i-- > 0;) {
+			*(void**)(slab + i * size) = freeList;
+			freeList = slab + i * size;
+		}
+	}
+	void* slot = freeList;
+	freeList = *(void**)slot;
+	live++;
+	acquired++;
+	return slot;
+}
+
+void Pool::release(void* slot) {
+	*(void**)slot = freeList;
+	freeList = slot;
+	live--;
+}
+
+}
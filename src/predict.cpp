@@ -0,0 +1,378 @@
+#include "globals.hpp"
+#include "idmap.hpp"
+#include "math.hpp"
+#include "predict.hpp"
+#include "render.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace obf {
+
+static std::thread predictThread;
+static std::mutex predictLock;
+static std::condition_variable predictWake;
+// guarded by predictLock
+static PredictJob pending;
+static std::shared_ptr<const Prediction> ready;
+static bool hasJob = false, working = false, stopping = false;
+
+// smallest step in ticks a prediction takes, keeps the step count bounded however predictDelta and predictMinDelta are set
+constexpr double minPredictDelta = 1.0 / 64.0;
+
+void snapshotPrediction(PredictJob& job) {
+	// the last fork in the arena was the prediction thread's and is done with
+	job.arena.reset();
+	job.world = captureWorld(job.arena, 8, !predictMassless);
+	job.world.massless = predictMassless;
+	// the only particles anyone looks at the trajectories of
+	auto addParticle = [&](Entity* e) {
+		uint32_t b = e->body;
+		if (!bodies.active[b] || bodies.attractor[b]) {
+			return;
+		}
+		uint32_t i = job.world.add(job.arena);
+		job.world.x[i] = bodies.x[b];
+		job.world.y[i] = bodies.y[b];
+		job.world.velX[i] = bodies.velX[b];
+		job.world.velY[i] = bodies.velY[b];
+		job.world.mass[i] = bodies.mass[b];
+		job.world.radius[i] = bodies.radius[b];
+		job.world.ids[i] = e->id;
+	};
+	if (predictMassless) {
+		if (ownEntity) {
+			addParticle(ownEntity);
+		}
+		if (trajectoryRef != ownEntity && trajectoryRef != systemCenter) {
+			addParticle(trajectoryRef);
+		}
+	}
+	auto slotOf = [&](Entity* e) {
+		for (size_t i = 0; i < job.world.count; i++) {
+			if (job.world.ids[i] == e->id) {
+				return (int32_t)i;
+			}
+		}
+		return (int32_t)-1;
+	};
+	job.ref = trajectoryRef == systemCenter ? -1 : slotOf(trajectoryRef);
+	job.refID = trajectoryRef->id;
+	job.ship = ownEntity ? slotOf(ownEntity) : -1;
+	if (job.ship >= 0) {
+		Triangle* ship = (Triangle*)ownEntity;
+		job.shipState = ShipState{ship->velX(), ship->velY(), ship->rotation, ship->rotateVel, ship->lastBoosted, ship->lastShot, ship->hyperboostCharge, ship->burning};
+		std::copy(std::begin(ship->color), std::end(ship->color), std::begin(job.shipColor));
+	}
+	job.controls = controls;
+	job.time = globalTime;
+	// a step that doesn't move time forward would never reach the horizon, NaNs fall to the floor too
+	job.step = std::max(minPredictDelta, predictDelta);
+	job.horizon = predictSteps * job.step;
+	job.adaptive = predictAdaptive;
+	job.accuracy = predictAccuracy;
+	job.minStep = std::max(minPredictDelta, predictMinDelta);
+	job.maxStep = std::max(job.minStep, predictMaxDelta);
+	job.tolerance = predictTolerance;
+	job.integrator = integrator;
+}
+
+// bodies that hit an attractor end there, attractors that hit each other merge into the heavier one
+static void collide(PredictJob& s) {
+	WorldState& w = s.world;
+	size_t n = w.count;
+	for (size_t a = 0; a < n; a++) {
+		if (!w.attractor[a] || !w.active[a]) {
+			continue;
+		}
+		for (size_t b = 0; b < n; b++) {
+			if (b == a || !w.active[b]) {
+				continue;
+			}
+			double reach = w.radius[a] + w.radius[b];
+			if (dst2(w.x[b] - w.x[a], w.y[b] - w.y[a]) > reach * reach) [[likely]] {
+				continue;
+			}
+			if (w.attractor[b]) {
+				if (w.mass[a] < w.mass[b]) {
+					continue;
+				}
+				w.radius[a] *= sqrt((w.mass[a] + w.mass[b]) / w.mass[a]);
+				w.mass[a] += w.mass[b];
+			}
+			w.active[b] = 0;
+		}
+	}
+}
+
+static void refPosition(const PredictJob& s, double& x, double& y) {
+	x = y = 0.0;
+	if (s.ref >= 0) {
+		x = s.world.x[s.ref];
+		y = s.world.y[s.ref];
+		return;
+	}
+	size_t count = 0;
+	for (size_t i = 0; i < s.world.count; i++) {
+		if (s.world.star[i] && s.world.active[i]) {
+			x += s.world.x[i];
+			y += s.world.y[i];
+			count++;
+		}
+	}
+	if (count) {
+		x /= count;
+		y /= count;
+	}
+}
+
+// ticks to step next, a small fraction of the shortest free-fall time sqrt(r^3 / GM) of any pulled body to an attractor
+// close approaches get short steps, coasting far from everything gets long ones
+static double adaptiveStep(const PredictJob& s) {
+	const WorldState& w = s.world;
+	double shortest2 = INFINITY;
+	for (size_t a = 0; a < w.count; a++) {
+		if (!w.attractor[a] || !w.active[a]) {
+			continue;
+		}
+		double gm = G * w.mass[a];
+		for (size_t b = 0; b < w.count; b++) {
+			if (b == a || !w.active[b] || w.rails[b]) {
+				continue;
+			}
+			double r2 = dst2(w.x[b] - w.x[a], w.y[b] - w.y[a]);
+			shortest2 = std::min(shortest2, r2 * sqrt(r2) / gm);
+		}
+	}
+	return std::clamp(s.accuracy * sqrt(shortest2), s.minStep, s.maxStep);
+}
+
+// one step of the job's world, the same order as a tick: move, collide, record, then steer
+static void step(PredictJob& s, Prediction& out, std::vector<uint32_t>& ghosts) {
+	WorldState& w = s.world;
+	double dt = s.adaptive ? adaptiveStep(s) : s.step;
+	advance(w, dt, selectScheme(s.integrator));
+	s.time += dt / 60.0;
+	s.shipState.rotation += s.shipState.rotateVel * dt;
+	collide(s);
+
+	double refX, refY;
+	refPosition(s, refX, refY);
+	for (size_t i = 0; i < out.trajectories.size(); i++) {
+		if (w.active[i]) {
+			out.trajectories[i].push_back({w.x[i] - refX, w.y[i] - refY, s.time});
+		}
+	}
+	for (size_t g = 0; g < ghosts.size(); g++) {
+		if (w.active[ghosts[g]]) {
+			out.ghosts[g].push_back({w.x[ghosts[g]] - refX, w.y[ghosts[g]] - refY, s.time});
+		}
+	}
+
+	if (s.ship < 0 || !w.active[s.ship]) {
+		return;
+	}
+	ShipState& ship = s.shipState;
+	ship.velX = w.velX[s.ship];
+	ship.velY = w.velY[s.ship];
+	Triangle::steer(ship, s.controls, dt, s.time);
+	w.velX[s.ship] = ship.velX;
+	w.velY[s.ship] = ship.velY;
+	if (ship.fired) {
+		// the same as Triangle::control, projectiles being 6 wide and 2000 heavy
+		float rotationRad = ship.rotation * degToRad;
+		double xMul = std::cos(rotationRad), yMul = std::sin(rotationRad);
+		uint32_t p = w.add(s.arena);
+		w.radius[p] = 6.0;
+		w.mass[p] = 2000.0;
+		w.x[p] = w.x[s.ship] + (w.radius[s.ship] + w.radius[p] * 2.0) * xMul;
+		w.y[p] = w.y[s.ship] - (w.radius[s.ship] + w.radius[p] * 2.0) * yMul;
+		w.velX[p] = w.velX[s.ship] + Triangle::shootPower * xMul;
+		w.velY[p] = w.velY[s.ship] - Triangle::shootPower * yMul;
+		w.velX[s.ship] -= Triangle::shootPower * xMul * w.mass[p] / w.mass[s.ship];
+		w.velY[s.ship] += Triangle::shootPower * yMul * w.mass[p] / w.mass[s.ship];
+		ghosts.push_back(p);
+		out.ghosts.emplace_back();
+		out.ghostColors.push_back(sf::Color(180 * 0.7, 0, 0));
+	}
+}
+
+// whether a and b would simulate the same way
+static bool sameSettings(const PredictJob& a, const PredictJob& b) {
+	return *(unsigned char*)&a.controls == *(unsigned char*)&b.controls && a.horizon == b.horizon && a.step == b.step
+		&& a.adaptive == b.adaptive && a.accuracy == b.accuracy && a.minStep == b.minStep && a.maxStep == b.maxStep
+		&& a.integrator == b.integrator;
+}
+
+// globalTime the last prediction can be carried on from for job, 0 if it has to start over
+// it still holds if the world hasn't strayed further than job.tolerance from it since
+static double reusableFrom(const Prediction& last, const PredictJob& lastState, const PredictJob& job) {
+	if (last.refID != job.refID || last.refCenter != (job.ref < 0) || last.ids.size() != job.world.count
+		|| !std::equal(last.ids.begin(), last.ids.end(), job.world.ids) || !sameSettings(lastState, job)) {
+		return 0.0;
+	}
+	double refX, refY, from = 0.0;
+	refPosition(job, refX, refY);
+	for (size_t i = 0; i < last.trajectories.size(); i++) {
+		const std::vector<Point>& traj = last.trajectories[i];
+		// the points either side of now, there has to be one in the past to carry on from
+		auto after = std::partition_point(traj.begin(), traj.end(), [&](const Point& p) { return p.time <= job.time; });
+		if (after == traj.begin() || after == traj.end()) {
+			return 0.0;
+		}
+		const Point& a = after[-1], & b = *after;
+		double frac = (job.time - a.time) / (b.time - a.time);
+		double x = a.x + (b.x - a.x) * frac, y = a.y + (b.y - a.y) * frac;
+		if (dst2(job.world.x[i] - refX - x, job.world.y[i] - refY - y) > job.tolerance * job.tolerance) {
+			return 0.0;
+		}
+		from = a.time;
+	}
+	return from;
+}
+
+// the points of traj after time
+static void dropBefore(std::vector<Point>& out, const std::vector<Point>& traj, double time) {
+	out.assign(std::partition_point(traj.begin(), traj.end(), [&](const Point& p) { return p.time <= time; }), traj.end());
+}
+
+static void predictLoop() {
+	PredictJob job, state;
+	std::vector<uint32_t> ghosts;
+	std::shared_ptr<const Prediction> last;
+	while (true) {
+		{
+			std::unique_lock guard(predictLock);
+			predictWake.wait(guard, [] { return hasJob || stopping; });
+			if (stopping) {
+				return;
+			}
+			std::swap(job, pending);
+			hasJob = false;
+		}
+		auto next = std::make_shared<Prediction>();
+		double from = last ? reusableFrom(*last, state, job) : 0.0;
+		if (from > 0.0) {
+			// drop what's in the past now and carry on from where the last one ended
+			next->ids = last->ids;
+			next->refID = last->refID;
+			next->refCenter = last->refCenter;
+			next->startTime = from;
+			next->trajectories.resize(last->trajectories.size());
+			for (size_t i = 0; i < last->trajectories.size(); i++) {
+				dropBefore(next->trajectories[i], last->trajectories[i], from);
+				next->reused = std::max(next->reused, (int)next->trajectories[i].size());
+			}
+			next->ghosts.resize(last->ghosts.size());
+			for (size_t g = 0; g < last->ghosts.size(); g++) {
+				dropBefore(next->ghosts[g], last->ghosts[g], from);
+			}
+			next->ghostColors = last->ghostColors;
+		} else {
+			std::swap(state, job);
+			ghosts.clear();
+			next->ids.assign(state.world.ids, state.world.ids + state.world.count);
+			next->refID = state.refID;
+			next->refCenter = state.ref < 0;
+			next->startTime = state.time;
+			next->trajectories.resize(state.world.count);
+			if (state.ship >= 0 && *(unsigned char*)&state.controls != 0) {
+				// where the ship would go without the controls held now
+				uint32_t ship = state.ship, g = state.world.add(state.arena);
+				state.world.x[g] = state.world.x[ship];
+				state.world.y[g] = state.world.y[ship];
+				state.world.velX[g] = state.world.velX[ship];
+				state.world.velY[g] = state.world.velY[ship];
+				state.world.mass[g] = state.world.mass[ship];
+				state.world.radius[g] = state.world.radius[ship];
+				ghosts.push_back(g);
+				next->ghosts.emplace_back();
+				next->ghostColors.push_back(sf::Color(state.shipColor[0] * 0.7, state.shipColor[1] * 0.7, state.shipColor[2] * 0.7));
+			}
+		}
+		// stop within half the smallest step of the end so rounding doesn't add one
+		double end = next->startTime + state.horizon / 60.0, slack = 0.5 * (state.adaptive ? state.minStep : state.step) / 60.0;
+		while (state.time < end - slack) {
+			step(state, *next, ghosts);
+		}
+		last = next;
+		std::lock_guard guard(predictLock);
+		ready = std::move(next);
+		working = false;
+	}
+}
+
+bool predictionBusy() {
+	std::lock_guard guard(predictLock);
+	return working;
+}
+
+bool requestPrediction(PredictJob& job) {
+	std::lock_guard guard(predictLock);
+	if (working) {
+		return false;
+	}
+	if (!predictThread.joinable()) {
+		stopping = false;
+		predictThread = std::thread(predictLoop);
+	}
+	std::swap(pending, job);
+	hasJob = working = true;
+	predictWake.notify_one();
+	return true;
+}
+
+bool applyPrediction() {
+	std::shared_ptr<const Prediction> prediction;
+	{
+		std::lock_guard guard(predictLock);
+		prediction = std::move(ready);
+	}
+	if (!prediction) {
+		return false;
+	}
+	// the reference body was deselected or changed while this was worked on
+	Entity* ref = trajectoryRef;
+	if (!ref || ref->id != prediction->refID) [[unlikely]] {
+		return false;
+	}
+	for (Entity* e : updateGroup) {
+		e->trajectory.clear();
+		e->trajectoryLine = noLine;
+	}
+	// drawing only needs the points again for where now is in them, the lines go to the GPU once here
+	for (size_t i = 0; i < prediction->ids.size(); i++) {
+		if (Entity* e = entityMap.get(prediction->ids[i])) {
+			e->trajectory = prediction->trajectories[i];
+			e->trajectoryLine = i;
+			trajectoryLines.upload(i, e->trajectory, sf::Color(e->color[0], e->color[1], e->color[2]));
+		}
+	}
+	ghostTrajectories = prediction->ghosts;
+	ghostTrajectoryColors = prediction->ghostColors;
+	for (size_t g = 0; g < ghostTrajectories.size(); g++) {
+		ghostLines.upload(g, ghostTrajectories[g], ghostTrajectoryColors[g]);
+	}
+	lastPredict = prediction->startTime;
+	lastTrajectoryRef = ref;
+	return true;
+}
+
+void stopPrediction() {
+	{
+		std::lock_guard guard(predictLock);
+		if (!predictThread.joinable()) {
+			return;
+		}
+		stopping = true;
+	}
+	predictWake.notify_one();
+	predictThread.join();
+}
+
+}
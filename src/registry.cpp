@@ -0,0 +1,50 @@
+#include "entities.hpp"
+#include "globals.hpp"
+#include "registry.hpp"
+
+namespace obf {
+
+Handle Registry::add(Entity* e) {
+	if (freeSlots.empty()) {
+		entities.push_back(e);
+		generations.push_back(0);
+		return {(uint32_t)(entities.size() - 1), 0};
+	}
+	uint32_t index = freeSlots.back();
+	freeSlots.pop_back();
+	entities[index] = e;
+	return {index, generations[index]};
+}
+
+void Registry::remove(Handle h) {
+	if (get(h) == nullptr) [[unlikely]] {
+		return;
+	}
+	entities[h.index] = nullptr;
+	generations[h.index]++;
+	freeSlots.push_back(h.index);
+}
+
+void addToGroup(Entity* e) {
+	e->groupIndex = updateGroup.size();
+	updateGroup.push_back(e);
+}
+
+void removeFromGroup(Entity* e) {
+	if (e->groupIndex == noGroup) [[unlikely]] {
+		return;
+	}
+	Entity* last = updateGroup.back();
+	updateGroup[e->groupIndex] = last;
+	last->groupIndex = e->groupIndex;
+	updateGroup.pop_back();
+	e->groupIndex = noGroup;
+}
+
+void reindexGroup() {
+	for (size_t i = 0; i < updateGroup.size(); i++) {
+		updateGroup[i]->groupIndex = i;
+	}
+}
+
+}
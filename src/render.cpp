@@ -0,0 +1,245 @@
+#include "entities.hpp"
+#include "camera.hpp"
+#include "globals.hpp"
+#include "math.hpp"
+#include "render.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <SFML/Graphics.hpp>
+
+namespace obf {
+
+// unit polygons by point count, starting at the top like sf::CircleShape
+static const std::vector<sf::Vector2f>& unitCircle(int points) {
+	static std::vector<std::vector<sf::Vector2f>> circles;
+	if ((size_t)points >= circles.size()) [[unlikely]] {
+		circles.resize(points + 1);
+	}
+	std::vector<sf::Vector2f>& circle = circles[points];
+	if (circle.empty()) [[unlikely]] {
+		for (int i = 0; i < points; i++) {
+			double angle = i * TAU / points - PI / 2.0;
+			circle.emplace_back(std::cos(angle), std::sin(angle));
+		}
+	}
+	return circle;
+}
+
+bool onScreen(double x, double y, double reach) {
+	// the world view is centered on the draw shift's origin
+	return std::abs(x) - reach <= g_camera.w * 0.5 * g_camera.scale && std::abs(y) - reach <= g_camera.h * 0.5 * g_camera.scale;
+}
+
+int circlePoints(double radius, int most) {
+	double pixels = radius / g_camera.scale;
+	if (pixels < lodIconRadius) {
+		return 0;
+	}
+	// a polygon's edges are r * (1 - cos(pi / n)) ~ r * pi^2 / 2n^2 inside the circle, n = 4 sqrt(r) makes that pi^2 / 32
+	return std::clamp((int)(std::sqrt(pixels) * 4.0), 4, std::max(most, 4));
+}
+
+void Batch::circle(float x, float y, float radius, int points, sf::Color color, float rotation) {
+	const std::vector<sf::Vector2f>& unit = unitCircle(points);
+	float rad = rotation * degToRad, c = std::cos(rad) * radius, s = std::sin(rad) * radius;
+	sf::Vector2f center(x, y);
+	auto at = [&](int i) {
+		const sf::Vector2f& p = unit[i % points];
+		return sf::Vector2f(x + p.x * c - p.y * s, y + p.x * s + p.y * c);
+	};
+	sf::Vector2f last = at(0);
+	for (int i = 1; i <= points; i++) {
+		sf::Vector2f next = at(i);
+		vertices.append(sf::Vertex(center, color));
+		vertices.append(sf::Vertex(last, color));
+		vertices.append(sf::Vertex(next, color));
+		last = next;
+	}
+}
+
+void Batch::ring(float x, float y, float radius, int points, float thickness, sf::Color color) {
+	const std::vector<sf::Vector2f>& unit = unitCircle(points);
+	// corners stick out further so the edges end up thickness wide
+	float outer = radius + thickness / std::cos(PI / points);
+	for (int i = 0; i < points; i++) {
+		const sf::Vector2f& a = unit[i], & b = unit[(i + 1) % points];
+		sf::Vector2f innerA(x + a.x * radius, y + a.y * radius), innerB(x + b.x * radius, y + b.y * radius),
+			outerA(x + a.x * outer, y + a.y * outer), outerB(x + b.x * outer, y + b.y * outer);
+		vertices.append(sf::Vertex(innerA, color));
+		vertices.append(sf::Vertex(outerA, color));
+		vertices.append(sf::Vertex(outerB, color));
+		vertices.append(sf::Vertex(innerA, color));
+		vertices.append(sf::Vertex(outerB, color));
+		vertices.append(sf::Vertex(innerB, color));
+	}
+}
+
+void Batch::rect(float x, float y, float w, float h, sf::Color color) {
+	sf::Vector2f a(x, y), b(x + w, y), c(x + w, y + h), d(x, y + h);
+	vertices.append(sf::Vertex(a, color));
+	vertices.append(sf::Vertex(b, color));
+	vertices.append(sf::Vertex(c, color));
+	vertices.append(sf::Vertex(a, color));
+	vertices.append(sf::Vertex(c, color));
+	vertices.append(sf::Vertex(d, color));
+}
+
+void Batch::flush() {
+	if (vertices.getVertexCount()) {
+		window->draw(vertices);
+	}
+	vertices.clear();
+}
+
+bool TextLayout::setAnsi(std::string_view text, unsigned size) {
+	if (size == this->size && unicode.isEmpty() && text == ansi) [[likely]] {
+		return false;
+	}
+	ansi = text;
+	unicode.clear();
+	this->size = size;
+	// the same as sf::String does with a std::string in the C locale
+	codepoints.assign(text.begin(), text.end());
+	for (uint32_t& c : codepoints) {
+		c = (unsigned char)c;
+	}
+	layout();
+	return true;
+}
+
+bool TextLayout::set(const sf::String& text, unsigned size) {
+	if (size == this->size && ansi.empty() && text == unicode) [[likely]] {
+		return false;
+	}
+	unicode = text;
+	ansi.clear();
+	this->size = size;
+	codepoints.assign(text.begin(), text.end());
+	layout();
+	return true;
+}
+
+void TextLayout::layout() {
+	// the same placement as sf::Text without styles: y is the baseline, glyph bounds are relative to it
+	vertices.clear();
+	float x = 0.f, y = size, minX = 0.f, maxX = 0.f,
+		whitespace = font->getGlyph(' ', size, false).advance, lineSpacing = font->getLineSpacing(size);
+	uint32_t last = 0;
+	for (uint32_t c : codepoints) {
+		x += font->getKerning(last, c, size);
+		last = c;
+		if (c == '\n') {
+			x = 0.f;
+			y += lineSpacing;
+			continue;
+		} else if (c == ' ') {
+			x += whitespace;
+			continue;
+		} else if (c == '\t') {
+			x += whitespace * 4.f;
+			continue;
+		}
+		const sf::Glyph& glyph = font->getGlyph(c, size, false);
+		float left = x + glyph.bounds.left, top = y + glyph.bounds.top,
+			right = left + glyph.bounds.width, bottom = top + glyph.bounds.height;
+		float u1 = glyph.textureRect.left, v1 = glyph.textureRect.top,
+			u2 = u1 + glyph.textureRect.width, v2 = v1 + glyph.textureRect.height;
+		sf::Vertex topLeft(sf::Vector2f(left, top), sf::Color::White, sf::Vector2f(u1, v1)),
+			topRight(sf::Vector2f(right, top), sf::Color::White, sf::Vector2f(u2, v1)),
+			bottomRight(sf::Vector2f(right, bottom), sf::Color::White, sf::Vector2f(u2, v2)),
+			bottomLeft(sf::Vector2f(left, bottom), sf::Color::White, sf::Vector2f(u1, v2));
+		vertices.push_back(topLeft);
+		vertices.push_back(topRight);
+		vertices.push_back(bottomRight);
+		vertices.push_back(topLeft);
+		vertices.push_back(bottomRight);
+		vertices.push_back(bottomLeft);
+		minX = std::min(minX, left);
+		maxX = std::max(maxX, right);
+		x += glyph.advance;
+	}
+	width = maxX - minX;
+}
+
+void TextBatch::add(const TextLayout& text, float x, float y, sf::Color color) {
+	size = text.size;
+	for (sf::Vertex v : text.vertices) {
+		v.position.x += x;
+		v.position.y += y;
+		v.color = color;
+		vertices.append(v);
+	}
+}
+
+void TextBatch::flush() {
+	if (vertices.getVertexCount()) {
+		// texture coordinates are in pixels of the page glyphs of this size are on
+		sf::RenderStates states(&font->getTexture(size));
+		window->draw(vertices, states);
+	}
+	vertices.clear();
+}
+
+void prepareGlyphs(unsigned size) {
+	for (uint32_t c = ' '; c <= '~'; c++) {
+		font->getGlyph(c, size, false);
+	}
+}
+
+void TrajectoryLines::upload(size_t i, const std::vector<Point>& points, sf::Color color) {
+	if (i >= lines.size()) {
+		lines.resize(i + 1);
+	}
+	Line& line = lines[i];
+	line.vertices.resize(points.size());
+	line.minX = line.minY = INFINITY;
+	line.maxX = line.maxY = -INFINITY;
+	float alpha = 255.f, decBy = (255.f - 64.f) / std::max(points.size(), (size_t)1);
+	for (size_t k = 0; k < points.size(); k++) {
+		line.vertices[k].position = sf::Vector2f(points[k].x, points[k].y);
+		line.vertices[k].color = color;
+		line.vertices[k].color.a = (uint8_t)alpha;
+		alpha -= decBy;
+		line.minX = std::min(line.minX, (float)points[k].x);
+		line.minY = std::min(line.minY, (float)points[k].y);
+		line.maxX = std::max(line.maxX, (float)points[k].x);
+		line.maxY = std::max(line.maxY, (float)points[k].y);
+	}
+	if (!sf::VertexBuffer::isAvailable() || points.empty()) {
+		return;
+	}
+	if (!line.buffer) {
+		line.buffer = std::make_unique<sf::VertexBuffer>(sf::LineStrip, sf::VertexBuffer::Dynamic);
+	}
+	// only grow the buffer, a shorter trajectory is drawn from the front of it
+	if (points.size() > line.capacity) {
+		line.capacity = points.size() * 2;
+		line.buffer->create(line.capacity);
+	}
+	line.buffer->update(line.vertices.data(), points.size(), 0);
+}
+
+void TrajectoryLines::draw(size_t i, size_t from, float x, float y) {
+	if (i >= lines.size() || from >= lines[i].vertices.size()) {
+		return;
+	}
+	Line& line = lines[i];
+	// the line's bounds where it gets drawn against the view, which is centered on the draw shift's origin
+	float halfW = (line.maxX - line.minX) * 0.5f, halfH = (line.maxY - line.minY) * 0.5f,
+		centerX = x + line.minX + halfW, centerY = y + line.minY + halfH;
+	if (std::abs(centerX) - halfW > g_camera.w * 0.5f * g_camera.scale || std::abs(centerY) - halfH > g_camera.h * 0.5f * g_camera.scale) {
+		return;
+	}
+	sf::RenderStates states;
+	states.transform.translate(x, y);
+	size_t count = line.vertices.size() - from;
+	if (line.buffer) {
+		window->draw(*line.buffer, from, count, states);
+	} else {
+		window->draw(line.vertices.data() + from, count, sf::LineStrip, states);
+	}
+}
+
+}
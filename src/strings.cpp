@@ -1,4 +1,7 @@
+#include "codec.hpp"
 #include "globals.hpp"
+#include "idmap.hpp"
+#include "loadtest.hpp"
 #include "net.hpp"
 #include "strings.hpp"
 #include "types.hpp"
@@ -226,9 +229,16 @@ void parseCommand (const string& command) {
 		printPreferred("help - print this\n"
 		"config <line> - parse argument like a config file line\n"
 		"lookup <id> - print info about entity ID in argument\n"
-		"showfps - print current framerate\n");
+		"showfps - print current framerate\n"
+		"ticktime - print how long ticks took over the last second and how much that varied\n"
+		"synctest - check the snapshot codec round trips within its error bounds\n"
+		"udptest - check delta snapshots survive loss, reordering and duplicates over loopback udp\n"
+		"gravitytest - check every gravity kernel the CPU supports gives bitwise identical results\n"
+		"energytest [steps] [delta] - compare how far each integrator lets the system's energy drift\n"
+		"pools - print how many projectiles are pooled and how often the pool went to the heap\n");
 		if (headless) {
 			printPreferred("reset - regenerate the star system\n"
+			"loadtest <clients> [seconds] - flood the server from fake loopback clients and compare ticktime with and without the network thread\n"
 			"players - list currently online players\n"
 			"say <message> - say argument into ingame chat\n");
 		}
@@ -273,7 +283,7 @@ void parseCommand (const string& command) {
 		sendMessage.append("Server: ").append(command.substr(4));
 		chatPacket << Packets::Chat << sendMessage;
 		for (Player* p : playerGroup) {
-			p->tcpSocket.send(chatPacket);
+			p->send(chatPacket);
 		}
 		cout << sendMessage << endl;
 		return;
@@ -288,12 +298,10 @@ void parseCommand (const string& command) {
 			return;
 		}
 		size_t id = stoi(id_s);
-		for (Entity* e : updateGroup) {
-			if (e->id == id) {
-				sprintf(out, "Mass %g, radius %g, relative to star 0: x %g, y %g, vX %g, vY %g\n", e->mass, e->radius, e->x - stars[0]->x, e->y - stars[0]->y, e->velX - stars[0]->velX, e->velY - stars[0]->velY);
-				printPreferred(string(out));
-				return;
-			}
+		if (Entity* e = entityMap.get(id)) {
+			sprintf(out, "Mass %g, radius %g, relative to star 0: x %g, y %g, vX %g, vY %g\n", e->mass(), e->radius(), e->x() - stars[0]->x(), e->y() - stars[0]->y(), e->velX() - stars[0]->velX(), e->velY() - stars[0]->velY());
+			printPreferred(string(out));
+			return;
 		}
 		printPreferred("No entity ID "+to_string(id)+" found.\n");
 		return;
@@ -302,8 +310,10 @@ void parseCommand (const string& command) {
 			displayMessage("This command only works if you're the server.");
 			return;
 		}
-		delta = 0.0;
-		for (Entity* e :updateGroup) {
+		skipStep = true;
+		// deleting takes entities out of updateGroup, so go over a copy
+		vector<Entity*> oldGroup(updateGroup);
+		for (Entity* e : oldGroup) {
 			if (e->type() != Entities::Triangle) {
 				delete e;
 			}
@@ -334,6 +344,63 @@ void parseCommand (const string& command) {
 			cout << "	<" << p->name() << ">" << endl;
 		}
 		return;
+	} else if (args[0] == "synctest") {
+		string report;
+		testCodec(report);
+		printPreferred(report);
+		return;
+	} else if (args[0] == "udptest") {
+		string report;
+		testUdpSync(report);
+		printPreferred(report);
+		return;
+	} else if (args[0] == "gravitytest") {
+		string report;
+		testGravityKernels(report);
+		printPreferred(report);
+		return;
+	} else if (args[0] == "energytest") {
+		int steps = 600;
+		double stepDelta = 60.0 / tickRate;
+		if (args.size() > 1) {
+			string steps_s = string(args[1]);
+			if (!regex_match(steps_s, int_regex)) {
+				printPreferred("Invalid argument.\n");
+				return;
+			}
+			steps = stoi(steps_s);
+		}
+		if (args.size() > 2) {
+			string delta_s = string(args[2]);
+			if (!regex_match(delta_s, double_regex)) {
+				printPreferred("Invalid argument.\n");
+				return;
+			}
+			stepDelta = stod(delta_s);
+		}
+		string report;
+		testIntegrators(report, steps, stepDelta);
+		printPreferred(report);
+		return;
+	} else if (args[0] == "pools") {
+		sprintf(out, "projectiles: %zu live, %zu acquired, %zu slabs allocated\n", projectilePool.live, projectilePool.acquired, projectilePool.slabs);
+		printPreferred(string(out));
+		return;
+	} else if (args[0] == "loadtest") {
+		if (!headless) {
+			displayMessage("This command only works if you're the server.");
+			return;
+		}
+		if (args.size() < 2 || !regex_match(args[1], int_regex) || args[1].empty() || (args.size() > 2 && !regex_match(args[2], double_regex))) {
+			printPreferred("Usage: loadtest <clients> [seconds]\n");
+			return;
+		}
+		startLoadTest(stoi(args[1]), args.size() > 2 ? stod(args[2]) : 5.0);
+		return;
+	} else if (args[0] == "ticktime") {
+		sprintf(out, "mean %.3fms, jitter %.3fms, worst %.3fms\n", tickTime * 1000.0, tickJitter * 1000.0, worstTick * 1000.0);
+		printPreferred(string(out));
+		return;
 	} else if (args[0] == "showfps") {
 		printPreferred(to_string(framerate)+"\n");
 		return;
@@ -0,0 +1,198 @@
+#include "bodies.hpp"
+#include "entities.hpp"
+#include "globals.hpp"
+#include "idmap.hpp"
+#include "types.hpp"
+#include "world.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace obf {
+
+void* Arena::allocate(size_t bytes, size_t align) {
+	size_t at = (used + align - 1) & ~(align - 1);
+	if (blocks.empty() || at + bytes > blockSize) {
+		// blocks double so a growing fork settles into one block after a few resets
+		blockSize = std::max({bytes + align, blockSize * 2, (size_t)64 << 10});
+		blocks.emplace_back(new char[blockSize]);
+		at = 0;
+	}
+	char* block = blocks.back().get();
+	// new[] only promises max_align_t, round the address itself
+	uintptr_t address = ((uintptr_t)(block + at) + align - 1) & ~(uintptr_t)(align - 1);
+	used = address - (uintptr_t)block + bytes;
+	return (void*)address;
+}
+
+void Arena::reset() {
+	if (blocks.size() > 1) {
+		std::swap(blocks.front(), blocks.back());
+		blocks.resize(1);
+	}
+	used = 0;
+}
+
+// points every array of world at fresh storage for capacity bodies
+static void place(WorldState& world, Arena& arena, size_t capacity) {
+	world.capacity = capacity;
+	world.x = arena.make<double>(capacity);
+	world.y = arena.make<double>(capacity);
+	world.velX = arena.make<double>(capacity);
+	world.velY = arena.make<double>(capacity);
+	world.mass = arena.make<double>(capacity);
+	world.radius = arena.make<double>(capacity);
+	world.attractor = arena.make<uint8_t>(capacity);
+	world.active = arena.make<uint8_t>(capacity);
+	world.rails = arena.make<uint8_t>(capacity);
+	world.star = arena.make<uint8_t>(capacity);
+	world.orbits = arena.make<Orbit>(capacity);
+	world.railParents = arena.make<int32_t>(capacity);
+	world.ids = arena.make<uint32_t>(capacity);
+}
+
+WorldState fork(const WorldState& world, Arena& arena, size_t extra) {
+	WorldState copy = world;
+	place(copy, arena, world.count + extra);
+	size_t n = world.count;
+	memcpy(copy.x, world.x, n * sizeof(double));
+	memcpy(copy.y, world.y, n * sizeof(double));
+	memcpy(copy.velX, world.velX, n * sizeof(double));
+	memcpy(copy.velY, world.velY, n * sizeof(double));
+	memcpy(copy.mass, world.mass, n * sizeof(double));
+	memcpy(copy.radius, world.radius, n * sizeof(double));
+	memcpy(copy.attractor, world.attractor, n);
+	memcpy(copy.active, world.active, n);
+	memcpy(copy.rails, world.rails, n);
+	// a view of the live bodies has no star, orbit or id arrays of its own
+	if (world.star) {
+		memcpy(copy.star, world.star, n);
+		memcpy(copy.orbits, world.orbits, n * sizeof(Orbit));
+		memcpy(copy.railParents, world.railParents, n * sizeof(int32_t));
+		memcpy(copy.ids, world.ids, n * sizeof(uint32_t));
+	} else {
+		// without orbits rails bodies can only coast
+		memset(copy.star, 0, n);
+		memset(copy.rails, 0, n);
+		std::fill(copy.orbits, copy.orbits + n, Orbit());
+		std::fill(copy.railParents, copy.railParents + n, -1);
+		std::fill(copy.ids, copy.ids + n, 0);
+	}
+	return copy;
+}
+
+uint32_t WorldState::add(Arena& arena) {
+	if (count == capacity) [[unlikely]] {
+		*this = fork(*this, arena, std::max(count, (size_t)16));
+	}
+	uint32_t i = count++;
+	x[i] = y[i] = velX[i] = velY[i] = mass[i] = radius[i] = 0.0;
+	attractor[i] = rails[i] = star[i] = 0;
+	active[i] = 1;
+	orbits[i] = Orbit();
+	railParents[i] = -1;
+	ids[i] = 0;
+	return i;
+}
+
+WorldState captureWorld(Arena& arena, size_t extra, bool particles) {
+	WorldState world;
+	place(world, arena, updateGroup.size() + extra);
+	world.railTime = railTime;
+	// live slot to fork slot, for rails parents
+	thread_local std::vector<int32_t> slotOf;
+	slotOf.assign(bodies.size(), -1);
+	for (Entity* e : updateGroup) {
+		uint32_t b = e->body;
+		if (!bodies.active[b] || (!particles && !bodies.attractor[b])) {
+			continue;
+		}
+		uint32_t i = world.count++;
+		slotOf[b] = i;
+		world.x[i] = bodies.x[b];
+		world.y[i] = bodies.y[b];
+		world.velX[i] = bodies.velX[b];
+		world.velY[i] = bodies.velY[b];
+		world.mass[i] = bodies.mass[b];
+		world.radius[i] = bodies.radius[b];
+		world.attractor[i] = bodies.attractor[b];
+		world.active[i] = 1;
+		world.rails[i] = bodies.rails[b];
+		world.star[i] = 0;
+		world.orbits[i] = Orbit();
+		world.railParents[i] = -1;
+		world.ids[i] = e->id;
+	}
+	for (Entity* e : updateGroup) {
+		int32_t i = slotOf[e->body];
+		if (i < 0 || e->type() != Entities::Attractor) {
+			continue;
+		}
+		Attractor* a = (Attractor*)e;
+		world.star[i] = a->star;
+		if (!world.rails[i]) {
+			continue;
+		}
+		world.orbits[i] = a->orbit;
+		if (a->railParent != noRailParent) {
+			Entity* parent = entityMap.get(a->railParent);
+			world.railParents[i] = parent ? slotOf[parent->body] : -1;
+			// the parent is gone, let it coast
+			if (world.railParents[i] < 0) {
+				world.rails[i] = 0;
+			}
+		}
+	}
+	return world;
+}
+
+// the fork's rails bodies to where their orbit has them at time, parents first
+static void followRails(WorldState& world, double time) {
+	thread_local std::vector<uint8_t> placed;
+	placed.assign(world.count, 0);
+	auto put = [&](auto& put, int32_t i) -> void {
+		if (placed[i]) {
+			return;
+		}
+		placed[i] = 1;
+		double parentX = 0.0, parentY = 0.0, parentVelX = 0.0, parentVelY = 0.0;
+		int32_t parent = world.railParents[i];
+		if (parent >= 0) {
+			if (world.rails[parent]) {
+				put(put, parent);
+			}
+			parentX = world.x[parent];
+			parentY = world.y[parent];
+			parentVelX = world.velX[parent];
+			parentVelY = world.velY[parent];
+		}
+		double x, y, velX, velY;
+		orbitState(world.orbits[i], time, x, y, velX, velY);
+		world.x[i] = parentX + x;
+		world.y[i] = parentY + y;
+		world.velX[i] = parentVelX + velX;
+		world.velY[i] = parentVelY + velY;
+	};
+	for (size_t i = 0; i < world.count; i++) {
+		if (world.rails[i] && world.active[i]) {
+			put(put, i);
+		}
+	}
+}
+
+void advance(WorldState& world, double dt, const Scheme& scheme) {
+	double drifted = 0.0;
+	for (int k = 0; k <= scheme.kicks; k++) {
+		if (scheme.drift[k] != 0.0) {
+			integrate(world, dt * scheme.drift[k], false);
+			drifted += scheme.drift[k];
+			followRails(world, world.railTime + dt * drifted);
+		}
+		if (k < scheme.kicks) {
+			applyGravity(world, dt * scheme.kick[k], false);
+		}
+	}
+	world.railTime += dt;
+}
+
+}